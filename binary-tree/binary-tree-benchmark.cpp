@@ -0,0 +1,244 @@
+// Author: Jakub Mazurkiewicz
+// C++ standard: 17
+
+#include "binary-tree.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+    // Key distributions. Each one generates `size` keys from [0, size).
+    struct sequential_keys {
+        static std::vector<int> generate(std::size_t size) {
+            std::vector<int> keys(size);
+            std::iota(keys.begin(), keys.end(), 0);
+            return keys;
+        }
+    };
+
+    struct shuffled_keys {
+        static std::vector<int> generate(std::size_t size) {
+            return generate_test_vector(size);
+        }
+    };
+
+    // Key k is drawn with probability proportional to 1 / (k + 1), so a few
+    // keys repeat very often.
+    struct zipfian_keys {
+        static std::vector<int> generate(std::size_t size) {
+            std::vector<double> cumulative(size);
+            double sum = 0.0;
+            for(std::size_t k = 0; k < size; ++k) {
+                sum += 1.0 / static_cast<double>(k + 1);
+                cumulative[k] = sum;
+            }
+
+            std::mt19937 generator{
+                static_cast<std::mt19937::result_type>(size)};
+            std::uniform_real_distribution<double> distribution{0.0, sum};
+
+            std::vector<int> keys(size);
+            for(int& key : keys) {
+                const auto it =
+                    std::lower_bound(cumulative.begin(), cumulative.end(),
+                                     distribution(generator));
+                key = static_cast<int>(std::min<std::ptrdiff_t>(
+                    it - cumulative.begin(), size - 1));
+            }
+            return keys;
+        }
+    };
+
+    template<typename Set>
+    bool contains(const Set& set, int key) {
+        return set.contains(key);
+    }
+
+    bool contains(const std::set<int>& set, int key) {
+        return set.find(key) != set.end();
+    }
+
+    template<typename Set>
+    void fill(Set& set, const std::vector<int>& keys) {
+        for(int key : keys) {
+            set.insert(key);
+        }
+    }
+
+    void set_items_processed(benchmark::State& state, std::size_t size) {
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) *
+                                static_cast<std::int64_t>(size));
+    }
+
+    template<typename Set, typename Keys>
+    void insert_benchmark(benchmark::State& state) {
+        const auto size = static_cast<std::size_t>(state.range(0));
+        const std::vector<int> keys = Keys::generate(size);
+
+        for(auto _ : state) {
+            auto set = std::make_unique<Set>();
+            fill(*set, keys);
+            benchmark::DoNotOptimize(set.get());
+
+            state.PauseTiming();
+            set.reset();
+            state.ResumeTiming();
+        }
+
+        set_items_processed(state, size);
+    }
+
+    template<typename Set, typename Keys>
+    void contains_benchmark(benchmark::State& state) {
+        const auto size = static_cast<std::size_t>(state.range(0));
+        const std::vector<int> keys = Keys::generate(size);
+        std::vector<int> queries = keys;
+        shuffle_test_vector(queries);
+
+        Set set;
+        fill(set, keys);
+
+        for(auto _ : state) {
+            std::size_t found = 0;
+            for(int query : queries) {
+                found += contains(set, query);
+            }
+            benchmark::DoNotOptimize(found);
+        }
+
+        set_items_processed(state, size);
+    }
+
+    template<typename Keys>
+    void frozen_contains_benchmark(benchmark::State& state) {
+        const auto size = static_cast<std::size_t>(state.range(0));
+        const std::vector<int> keys = Keys::generate(size);
+        std::vector<int> queries = keys;
+        shuffle_test_vector(queries);
+
+        tree<int, avl_balancing> source;
+        fill(source, keys);
+        const frozen_tree<int> set(source);
+
+        for(auto _ : state) {
+            std::size_t found = 0;
+            for(int query : queries) {
+                found += set.contains(query);
+            }
+            benchmark::DoNotOptimize(found);
+        }
+
+        set_items_processed(state, size);
+    }
+
+    template<typename Set, typename Keys>
+    void erase_benchmark(benchmark::State& state) {
+        const auto size = static_cast<std::size_t>(state.range(0));
+        const std::vector<int> keys = Keys::generate(size);
+        std::vector<int> erased = keys;
+        shuffle_test_vector(erased);
+
+        for(auto _ : state) {
+            state.PauseTiming();
+            Set set;
+            fill(set, keys);
+            state.ResumeTiming();
+
+            for(int key : erased) {
+                set.erase(key);
+            }
+            benchmark::DoNotOptimize(set.size());
+        }
+
+        set_items_processed(state, size);
+    }
+
+    template<typename Set, typename Keys>
+    void teardown_benchmark(benchmark::State& state) {
+        const auto size = static_cast<std::size_t>(state.range(0));
+        const std::vector<int> keys = Keys::generate(size);
+
+        for(auto _ : state) {
+            state.PauseTiming();
+            auto set = std::make_unique<Set>();
+            fill(*set, keys);
+            state.ResumeTiming();
+
+            set.reset();
+        }
+
+        set_items_processed(state, size);
+    }
+
+    // Sorted keys make the unbalanced tree a list, so its runs are quadratic
+    // and have to stay small.
+    constexpr std::int64_t min_size = 1'000;
+    constexpr std::int64_t max_size = 100'000'000;
+    constexpr std::int64_t max_degenerate_size = 10'000;
+
+    template<typename Set, typename Keys>
+    void register_set(const char* set_name, const char* keys_name) {
+        const bool degenerate = std::is_same_v<Set, tree<int>> &&
+                                std::is_same_v<Keys, sequential_keys>;
+        const std::int64_t last_size =
+            degenerate ? max_degenerate_size : max_size;
+
+        const auto add = [&](const char* operation, auto function) {
+            const std::string name = std::string{operation} + '/' + set_name +
+                                     '/' + keys_name;
+            benchmark::RegisterBenchmark(name.c_str(), function)
+                ->RangeMultiplier(10)
+                ->Range(min_size, last_size)
+                ->Unit(benchmark::kMillisecond);
+        };
+
+        add("insert", insert_benchmark<Set, Keys>);
+        add("contains", contains_benchmark<Set, Keys>);
+        add("erase", erase_benchmark<Set, Keys>);
+        add("teardown", teardown_benchmark<Set, Keys>);
+    }
+
+    template<typename Keys>
+    void register_keys(const char* keys_name) {
+        register_set<std::set<int>, Keys>("std::set", keys_name);
+        register_set<tree<int>, Keys>("tree", keys_name);
+        register_set<tree<int, avl_balancing>, Keys>("avl_tree", keys_name);
+        register_set<tree<int, splay_balancing>, Keys>("splay_tree", keys_name);
+        register_set<tree<int, avl_balancing, pool_allocator<int>>, Keys>(
+            "pooled_avl_tree", keys_name);
+        register_set<compact_tree<int>, Keys>("compact_tree", keys_name);
+
+        const std::string name =
+            std::string{"contains/frozen_tree/"} + keys_name;
+        benchmark::RegisterBenchmark(name.c_str(),
+                                     frozen_contains_benchmark<Keys>)
+            ->RangeMultiplier(10)
+            ->Range(min_size, max_size)
+            ->Unit(benchmark::kMillisecond);
+    }
+} // namespace
+
+// Sizes range from 1e3 to 1e8 values, so use --benchmark_filter to select a
+// subset, e.g. --benchmark_filter='contains/.*/shuffled/1000000$'.
+int main(int argc, char* argv[]) {
+    register_keys<sequential_keys>("sequential");
+    register_keys<shuffled_keys>("shuffled");
+    register_keys<zipfian_keys>("zipfian");
+
+    benchmark::Initialize(&argc, argv);
+    if(benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
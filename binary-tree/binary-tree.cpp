@@ -1,281 +1,615 @@
 // Author: Jakub Mazurkiewicz
 // C++ standard: 17
 
+#include "binary-tree.hpp"
+
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <numeric>
+#include <optional>
 #include <random>
+#include <stdexcept>
 #include <string>
-#include <utility>
+#include <string_view>
+#include <thread>
 #include <vector>
 
-template<typename T>
-struct tree_node {
-    template<typename... Args>
-    tree_node(Args&&... args)
-        : value(std::forward<Args>(args)...)
-        , parent{nullptr}
-        , left{nullptr}
-        , right{nullptr} { }
-
-    T value;
-
-    tree_node* parent;
-    tree_node* left;
-    tree_node* right;
-
-    void attach_on_left(tree_node* new_left) {
-        left = new_left;
-        if(new_left != nullptr) {
-            new_left->parent = this;
-        }
+#if defined(_WIN32)
+#    include <psapi.h>
+#else
+#    include <sys/resource.h>
+#endif
+
+template<typename Tree>
+void fill_and_empty(std::vector<int> test_vector) {
+    Tree test_tree;
+    for(int e : test_vector) {
+        test_tree.insert(e);
     }
 
-    void attach_on_right(tree_node* new_right) {
-        right = new_right;
-        if(new_right != nullptr) {
-            new_right->parent = this;
-        }
+    assert(test_vector.size() == test_tree.size());
+    for(int e : test_vector) {
+        [[maybe_unused]] const auto [it, inserted] = test_tree.try_emplace(e);
+        assert(!inserted && *it == e);
+    }
+    assert(test_vector.size() == test_tree.size());
+    std::cout << "Tree was successfully filled with values from 0 to "
+              << test_vector.size() << '.' << std::endl;
+
+    shuffle_test_vector(test_vector);
+    for(int e : test_vector) {
+        test_tree.erase(e);
     }
 
-    void replace_child(tree_node* old_child, tree_node* new_child) {
-        if(left == old_child) {
-            attach_on_left(new_child);
-            old_child->parent = nullptr;
-        } else if(right == old_child) {
-            attach_on_right(new_child);
-            old_child->parent = nullptr;
+    assert(test_tree.empty() == true);
+    std::cout << "Tree was successfully emptied.\n";
+}
+
+template<typename Tree>
+void assign_sorted(const std::vector<int>& sorted_vector) {
+    Tree test_tree;
+    test_tree.assign_sorted(sorted_vector.begin(), sorted_vector.end());
+
+    assert(sorted_vector.size() == test_tree.size());
+    assert(std::equal(test_tree.begin(), test_tree.end(), sorted_vector.begin(),
+                      sorted_vector.end()));
+    assert(std::equal(std::make_reverse_iterator(test_tree.end()),
+                      std::make_reverse_iterator(test_tree.begin()),
+                      sorted_vector.rbegin(), sorted_vector.rend()));
+    assert(std::all_of(sorted_vector.begin(), sorted_vector.end(),
+                       [&](int e) { return test_tree.contains(e); }));
+    std::cout << "Tree was successfully built from sorted values.\n";
+
+    [[maybe_unused]] const int range_first =
+        static_cast<int>(sorted_vector.size() / 4);
+    [[maybe_unused]] const int range_last =
+        static_cast<int>(sorted_vector.size() / 2);
+    assert(std::distance(test_tree.lower_bound(range_first),
+                         test_tree.lower_bound(range_last)) ==
+           range_last - range_first);
+    assert(range_first == range_last ||
+           test_tree.upper_bound(range_first) ==
+               std::next(test_tree.lower_bound(range_first)));
+    assert(test_tree.equal_range(-1).first ==
+           test_tree.equal_range(-1).second);
+    std::cout << "Range queries were successful.\n";
+
+    const frozen_tree<int> frozen(test_tree);
+    assert(sorted_vector.size() == frozen.size());
+    assert(std::all_of(sorted_vector.begin(), sorted_vector.end(),
+                       [&](int e) { return frozen.contains(e); }));
+    assert(!frozen.contains(-1));
+    assert(!frozen.contains(static_cast<int>(sorted_vector.size())));
+    std::cout << "Tree was successfully frozen.\n";
+
+    std::vector<int> queries(2 * sorted_vector.size());
+    std::iota(queries.begin(), queries.end(), -1);
+    const std::unique_ptr<bool[]> tree_results(new bool[queries.size()]);
+    const std::unique_ptr<bool[]> frozen_results(new bool[queries.size()]);
+    test_tree.contains_batch(queries.data(), queries.size(),
+                             tree_results.get());
+    frozen.contains_batch(queries.data(), queries.size(),
+                          frozen_results.get());
+    for(std::size_t i = 0; i < queries.size(); ++i) {
+        assert(tree_results[i] == test_tree.contains(queries[i]));
+        assert(frozen_results[i] == tree_results[i]);
+    }
+    std::cout << "Batched lookups were successful.\n";
+
+    const std::string snapshot_path =
+        (std::filesystem::temp_directory_path() / "binary-tree-snapshot.bin")
+            .string();
+    frozen.save_snapshot(snapshot_path);
+    {
+        const frozen_tree<int> mapped =
+            frozen_tree<int>::map_snapshot(snapshot_path);
+        assert(mapped.size() == frozen.size());
+        for([[maybe_unused]] int query : queries) {
+            assert(mapped.contains(query) == frozen.contains(query));
         }
     }
-};
+    std::filesystem::remove(snapshot_path);
+    std::cout << "Tree snapshot was successfully saved and mapped.\n";
+}
 
-template<typename T>
-class tree {
-public:
-    using value_type = T;
-    using size_type = std::size_t;
+template<typename Tree>
+void move_nodes(const std::vector<int>& test_vector) {
+    std::vector<Tree> trees(1);
+    for(int e : test_vector) {
+        trees.front().insert(e);
+    }
 
-private:
-    using node = tree_node<value_type>;
-    using node_ptr = node*;
+    trees.push_back(std::move(trees.front()));
+    assert(trees.front().empty());
+    assert(trees.back().size() == test_vector.size());
 
-    node_ptr root;
-    size_type tree_size;
+    Tree& source = trees.back();
+    Tree target(source.get_allocator());
+    for(int e : test_vector) {
+        [[maybe_unused]] const auto result = target.insert(source.extract(e));
+        assert(result.inserted && *result.position == e);
+    }
+    assert(source.empty() && target.size() == test_vector.size());
 
-public:
-    tree()
-        : root{nullptr}
-        , tree_size{0} { }
+    swap(source, target);
+    assert(target.empty() && source.size() == test_vector.size());
+    std::cout << "Nodes were successfully moved between trees.\n";
+}
 
-    tree(const tree&) = delete;
-    tree& operator=(const tree&) = delete;
+template<typename Tree>
+void select_by_position(const std::vector<int>& test_vector) {
+    Tree test_tree;
+    for(int e : test_vector) {
+        test_tree.insert(e);
+    }
 
-    ~tree() {
-        if(!empty()) {
-            remove_subtree(root);
-        }
+    std::vector<int> sorted_vector = test_vector;
+    std::sort(sorted_vector.begin(), sorted_vector.end());
+    for(std::size_t i = 0; i < sorted_vector.size(); ++i) {
+        assert(*test_tree.nth(i) == sorted_vector[i]);
+        assert(test_tree.rank(sorted_vector[i]) == i);
     }
+    assert(test_tree.nth(sorted_vector.size()) == test_tree.end());
 
-private:
-    void remove_subtree(node_ptr node) {
-        if(node->left != nullptr) {
-            remove_subtree(node->left);
-        }
-        if(node->right != nullptr) {
-            remove_subtree(node->right);
-        }
+    // Values at odd positions of `sorted_vector` are erased.
+    for(std::size_t i = 1; i < sorted_vector.size(); i += 2) {
+        test_tree.erase(sorted_vector[i]);
+    }
+    for(std::size_t i = 0; i < sorted_vector.size(); i += 2) {
+        assert(*test_tree.nth(i / 2) == sorted_vector[i]);
+        assert(test_tree.rank(sorted_vector[i]) == i / 2);
+    }
+    std::cout << "Values were successfully selected by their positions.\n";
+}
 
-        delete node;
+// After a lookup, the value found is in the root of a self-adjusting tree, so
+// looking it up again takes two comparisons.
+template<typename Tree>
+void access_repeatedly(const std::vector<int>& test_vector) {
+    Tree test_tree;
+    for(int e : test_vector) {
+        test_tree.insert(e);
     }
 
-public:
-    size_type size() const {
-        return tree_size;
+    // stats() visits all nodes, so only some values are checked.
+    const std::size_t step = std::max<std::size_t>(test_vector.size() / 64, 1);
+    for(std::size_t i = 0; i < test_vector.size(); i += step) {
+        assert(test_tree.contains(test_vector[i]));
+        [[maybe_unused]] const auto comparisons =
+            test_tree.stats().comparisons;
+        assert(test_tree.contains(test_vector[i]));
+        assert(test_tree.stats().comparisons == comparisons + 2);
     }
+    assert(std::all_of(test_vector.begin(), test_vector.end(),
+                       [&](int e) { return test_tree.contains(e); }));
+    std::cout << "Recently accessed values were successfully found.\n";
+}
 
-    bool empty() const {
-        return size() == 0;
+// AVL tree of n values is never deeper than 1.44 * log2(n + 2).
+template<typename Tree>
+void collect_stats(const std::vector<int>& test_vector) {
+    Tree test_tree;
+    for(int e : test_vector) {
+        test_tree.insert(e);
     }
 
-    bool insert(const value_type& value) {
-        return emplace(value);
+    [[maybe_unused]] const tree_statistics stats = test_tree.stats();
+    assert(stats.allocations == test_vector.size());
+    assert(stats.deallocations == 0);
+    assert(test_vector.size() < 3 || stats.rotations > 0);
+    assert(stats.comparisons + 1 >= test_vector.size());
+
+    std::size_t log_size = 0;
+    while((std::size_t{1} << log_size) < test_vector.size() + 2) {
+        ++log_size;
     }
+    assert(stats.max_depth <= 3 * log_size / 2);
+    assert(stats.average_depth <= stats.max_depth);
+
+    test_tree.clear();
+    assert(test_tree.stats().deallocations == test_vector.size());
+
+    // Batches allocate nodes only for values which are not stored yet.
+    const auto half = static_cast<std::ptrdiff_t>(test_vector.size() / 2);
+    test_tree.insert_batch(test_vector.begin(), test_vector.begin() + half);
+    test_tree.insert_batch(test_vector.begin(), test_vector.end());
+    [[maybe_unused]] const tree_statistics batch_stats = test_tree.stats();
+    assert(test_tree.size() == test_vector.size());
+    assert(batch_stats.allocations == 2 * test_vector.size());
+    assert(batch_stats.deallocations == test_vector.size());
+    std::cout << "Tree statistics were successfully collected.\n";
+}
 
-    template<typename... Args>
-    bool emplace(Args&&... args) {
-        const node_ptr new_node = new node(std::forward<Args>(args)...);
+template<typename Tree>
+void look_up_strings(const std::vector<int>& test_vector) {
+    Tree test_tree;
+    for(int e : test_vector) {
+        test_tree.insert(std::to_string(e));
+    }
 
-        if(empty()) {
-            root = new_node;
-        } else if(!try_insert(root, new_node)) {
-            delete new_node;
-            return false;
-        }
+    for(int e : test_vector) {
+        const std::string key = std::to_string(e);
+        assert(test_tree.contains(std::string_view{key}));
+        assert(*test_tree.find(key.c_str()) == key);
+    }
+    assert(test_tree.find("-1") == test_tree.end());
 
-        ++tree_size;
-        return true;
+    for(int e : test_vector) {
+        test_tree.erase(std::string_view{std::to_string(e)});
     }
+    assert(test_tree.empty());
+    std::cout << "Strings were successfully looked up by views.\n";
+}
 
-private:
-    bool try_insert(node_ptr subtree, node_ptr new_node) {
-        bool success = false;
+template<typename Tree>
+void mutate_in_batches(const std::vector<int>& test_vector) {
+    std::vector<int> batch = test_vector;
+    batch.insert(batch.end(), test_vector.begin(), test_vector.end());
+
+    Tree test_tree;
+    test_tree.insert_batch(batch.begin(), batch.end());
+    assert(test_tree.size() == test_vector.size());
+    assert(std::equal(test_tree.begin(), test_tree.end(), test_vector.begin(),
+                      test_vector.end()));
+
+    // Values at odd positions of `test_vector` are erased, each one twice.
+    std::vector<int> erased;
+    for(std::size_t i = 1; i < test_vector.size(); i += 2) {
+        erased.push_back(test_vector[i]);
+        erased.push_back(test_vector[i]);
+    }
+    test_tree.erase_batch(erased.begin(), erased.end());
+    for(std::size_t i = 0; i < test_vector.size(); ++i) {
+        assert(test_tree.contains(test_vector[i]) == (i % 2 == 0));
+    }
 
-        if(new_node->value < subtree->value) {
-            if(subtree->left == nullptr) {
-                subtree->attach_on_left(new_node);
-                success = true;
-            } else {
-                success = try_insert(subtree->left, new_node);
-            }
+    test_tree.erase_batch(test_vector.begin(), test_vector.end());
+    assert(test_tree.empty() && test_tree.begin() == test_tree.end());
+    std::cout << "Batches of values were successfully inserted and erased.\n";
+}
 
-        } else if(subtree->value < new_node->value) {
-            if(subtree->right == nullptr) {
-                subtree->attach_on_right(new_node);
-                success = true;
-            } else {
-                success = try_insert(subtree->right, new_node);
-            }
-        }
+// First tree gets first two thirds of `test_vector` and second one gets last
+// two thirds, so they share the middle third.
+template<typename Tree>
+void combine_sets(const std::vector<int>& test_vector) {
+    const auto third = static_cast<std::ptrdiff_t>(test_vector.size() / 3);
+    const auto first_end = test_vector.begin() + 2 * third;
+    const auto second_begin = test_vector.begin() + third;
+
+    const auto fill = [](Tree& test_tree, auto first, auto last) {
+        std::for_each(first, last, [&](int e) { test_tree.insert(e); });
+    };
+
+    Tree united;
+    Tree other;
+    fill(united, test_vector.begin(), first_end);
+    fill(other, second_begin, test_vector.end());
+    united.union_with(other);
+    assert(united.size() == test_vector.size() && other.empty());
+
+    Tree common;
+    fill(common, test_vector.begin(), first_end);
+    fill(other, second_begin, test_vector.end());
+    common.intersect_with(other);
+    assert(common.size() == static_cast<std::size_t>(third) && other.empty());
+
+    Tree difference;
+    fill(difference, test_vector.begin(), first_end);
+    fill(other, second_begin, test_vector.end());
+    difference.difference_with(other);
+    assert(difference.size() == static_cast<std::size_t>(third) &&
+           other.empty());
+    assert(std::all_of(test_vector.begin(), second_begin,
+                       [&](int e) { return difference.contains(e); }));
+
+    std::cout << "Set operations were successful.\n";
+}
 
-        return success;
+void store_compactly(std::vector<int> test_vector) {
+    compact_tree<int> test_tree;
+    for(int e : test_vector) {
+        [[maybe_unused]] const bool inserted = test_tree.insert(e);
+        assert(inserted);
     }
+    assert(std::none_of(test_vector.begin(), test_vector.end(),
+                        [&](int e) { return test_tree.insert(e); }));
+    assert(test_tree.size() == test_vector.size());
 
-public:
-    bool contains(const value_type& value) const {
-        return find_at(root, value) != nullptr;
-    }
+    std::vector<int> sorted_vector = test_vector;
+    std::sort(sorted_vector.begin(), sorted_vector.end());
+    assert(std::equal(test_tree.begin(), test_tree.end(),
+                      sorted_vector.begin(), sorted_vector.end()));
 
-private:
-    node_ptr find_at(node_ptr subtree, const value_type& value) const {
-        if(subtree == nullptr) {
-            return nullptr;
-        }
+    shuffle_test_vector(test_vector);
+    for(int e : test_vector) {
+        test_tree.erase(e);
+        assert(!test_tree.contains(e));
+    }
+    assert(test_tree.empty() && test_tree.begin() == test_tree.end());
+    std::cout << "Compact tree was successfully filled and emptied.\n";
+}
 
-        if(value < subtree->value) {
-            return find_at(subtree->left, value);
-        } else if(subtree->value < value) {
-            return find_at(subtree->right, value);
-        }
+// Values from `test_vector` at even positions stay in the tree while the
+// other ones are inserted and erased; readers must always find the former.
+void read_concurrently(const std::vector<int>& test_vector) {
+    concurrent_tree<int> test_tree;
+    for(std::size_t i = 0; i < test_vector.size(); i += 2) {
+        test_tree.insert(test_vector[i]);
+    }
 
-        return subtree;
+    std::atomic<bool> done{false};
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> readers;
+
+    for(int reader = 0; reader < 2; ++reader) {
+        readers.emplace_back([&] {
+            while(!done.load()) {
+                for(std::size_t i = 0; i < test_vector.size(); i += 2) {
+                    if(!test_tree.contains(test_vector[i])) {
+                        failed.store(true);
+                    }
+                }
+            }
+        });
     }
 
-public:
-    void erase(const value_type& value) {
-        if(const node_ptr node_to_erase = find_at(root, value);
-           node_to_erase != nullptr) {
-            extract_node(node_to_erase);
-            delete node_to_erase;
-            --tree_size;
-        }
+    for(std::size_t i = 1; i < test_vector.size(); i += 2) {
+        test_tree.insert(test_vector[i]);
+    }
+    for(std::size_t i = 1; i < test_vector.size(); i += 2) {
+        test_tree.erase(test_vector[i]);
     }
 
-private:
-    void extract_node(node_ptr node) {
-        if(node->left == nullptr && node->right == nullptr) {
-            extract_leaf(node);
-        } else if(node->left != nullptr && node->right != nullptr) {
-            extract_double_node(node);
-        } else {
-            extract_single_node(node);
-        }
+    done.store(true);
+    for(std::thread& reader : readers) {
+        reader.join();
     }
 
-    void extract_leaf(node_ptr leaf_to_erase) {
-        if(node_ptr parent = leaf_to_erase->parent; parent != nullptr) {
-            parent->replace_child(leaf_to_erase, nullptr);
-        } else {
-            root = nullptr;
+    assert(!failed.load());
+    assert(test_tree.size() == (test_vector.size() + 1) / 2);
+    std::cout << "Tree was successfully read concurrently.\n";
+}
+
+// Timing mode measures filling trees with `keys` and erasing them in other
+// order. Results are verified even if asserts are disabled.
+namespace timing {
+    struct result {
+        std::string tree_name;
+        double fill_nanoseconds = 0.0;
+        double drain_nanoseconds = 0.0;
+        std::size_t height = 0;
+        std::size_t peak_rss = 0;
+    };
+
+    void require(bool condition, const std::string& message) {
+        if(!condition) {
+            throw std::runtime_error(message);
         }
     }
 
-    void extract_single_node(node_ptr node_to_erase) {
-        const node_ptr child =
-            (node_to_erase->left != nullptr ? node_to_erase->left
-                                            : node_to_erase->right);
-
-        if(node_ptr parent = node_to_erase->parent; parent != nullptr) {
-            parent->replace_child(node_to_erase, child);
-        } else {
-            root = child;
-            child->parent = nullptr;
+    // Returns the largest resident set size of the process so far in bytes.
+    std::size_t peak_rss() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if(GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                                sizeof(counters))) {
+            return counters.PeakWorkingSetSize;
+        }
+        return 0;
+#else
+        rusage usage;
+        if(getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
         }
+#    if defined(__APPLE__)
+        return static_cast<std::size_t>(usage.ru_maxrss);
+#    else
+        return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#    endif
+#endif
     }
 
-    void extract_double_node(node_ptr node_to_erase) {
-        const node_ptr min_node = extract_min_node(node_to_erase->right);
+    template<typename Tree>
+    std::size_t height(const Tree& test_tree) {
+        return test_tree.stats().max_depth;
+    }
 
-        if(node_ptr parent = node_to_erase->parent; parent != nullptr) {
-            parent->replace_child(node_to_erase, min_node);
-        } else {
-            root = min_node;
-            min_node->parent = nullptr;
-        }
+    std::size_t height(const compact_tree<int>& test_tree) {
+        return test_tree.height();
+    }
 
-        min_node->attach_on_left(node_to_erase->left);
-        min_node->attach_on_right(node_to_erase->right);
+    template<typename Function>
+    double measure(Function function) {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        const auto stop = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(stop - start).count();
     }
 
-    node_ptr extract_min_node(node_ptr subtree) {
-        while(subtree->left != nullptr) {
-            subtree = subtree->left;
-        }
+    template<typename Tree>
+    result time_tree(const std::string& tree_name,
+                     const std::vector<int>& keys,
+                     const std::vector<int>& erase_order) {
+        result tree_result;
+        tree_result.tree_name = tree_name;
+
+        Tree test_tree;
+        tree_result.fill_nanoseconds = measure([&] {
+            for(int key : keys) {
+                test_tree.insert(key);
+            }
+        });
+        require(test_tree.size() == keys.size(),
+                tree_name + " has wrong size after filling");
+        require(std::is_sorted(test_tree.begin(), test_tree.end()),
+                tree_name + " is not sorted after filling");
+        tree_result.height = height(test_tree);
+
+        tree_result.drain_nanoseconds = measure([&] {
+            for(int key : erase_order) {
+                test_tree.erase(key);
+            }
+        });
+        require(test_tree.empty(), tree_name + " is not empty after draining");
 
-        if(subtree->right != nullptr) {
-            extract_single_node(subtree);
-        } else {
-            extract_leaf(subtree);
-        }
+        tree_result.peak_rss = peak_rss();
+        return tree_result;
+    }
 
-        return subtree;
+    double per_operation(double nanoseconds, std::size_t size) {
+        return size != 0 ? nanoseconds / static_cast<double>(size) : 0.0;
     }
-};
 
-void shuffle_test_vector(std::vector<int>& test_vector) {
-    static std::mt19937 generator{std::random_device{}()};
-    std::shuffle(test_vector.begin(), test_vector.end(), generator);
-}
+    double per_second(double nanoseconds, std::size_t size) {
+        return nanoseconds != 0.0
+                   ? static_cast<double>(size) * 1e9 / nanoseconds
+                   : 0.0;
+    }
 
-std::vector<int> generate_test_vector(std::size_t size) {
-    std::vector<int> test_vector(size);
+    void print_json(const std::vector<result>& results, std::size_t size,
+                    std::mt19937::result_type seed) {
+        std::cout << "{\n  \"size\": " << size << ",\n  \"seed\": " << seed
+                  << ",\n  \"results\": [";
+        for(std::size_t i = 0; i < results.size(); ++i) {
+            const result& r = results[i];
+            std::cout << (i == 0 ? "\n" : ",\n") << "    {\"tree\": \""
+                      << r.tree_name << "\", \"fill_ns_per_op\": "
+                      << per_operation(r.fill_nanoseconds, size)
+                      << ", \"fill_ops_per_second\": "
+                      << per_second(r.fill_nanoseconds, size)
+                      << ", \"drain_ns_per_op\": "
+                      << per_operation(r.drain_nanoseconds, size)
+                      << ", \"drain_ops_per_second\": "
+                      << per_second(r.drain_nanoseconds, size)
+                      << ", \"height\": " << r.height
+                      << ", \"peak_rss_bytes\": " << r.peak_rss << "}";
+        }
+        std::cout << "\n  ]\n}\n";
+    }
 
-    std::iota(test_vector.begin(), test_vector.end(), 0);
-    shuffle_test_vector(test_vector);
+    void print_csv(const std::vector<result>& results, std::size_t size,
+                   std::mt19937::result_type seed) {
+        std::cout << "tree,size,seed,fill_ns_per_op,fill_ops_per_second,"
+                     "drain_ns_per_op,drain_ops_per_second,height,"
+                     "peak_rss_bytes\n";
+        for(const result& r : results) {
+            std::cout << r.tree_name << ',' << size << ',' << seed << ','
+                      << per_operation(r.fill_nanoseconds, size) << ','
+                      << per_second(r.fill_nanoseconds, size) << ','
+                      << per_operation(r.drain_nanoseconds, size) << ','
+                      << per_second(r.drain_nanoseconds, size) << ','
+                      << r.height << ',' << r.peak_rss << '\n';
+        }
+    }
 
-    return test_vector;
-}
+    void run(const std::string& format, std::size_t size,
+             std::mt19937::result_type seed) {
+        const std::vector<int> keys = generate_test_vector(size);
+        std::vector<int> erase_order = keys;
+        shuffle_test_vector(erase_order);
+
+        // Peak RSS never decreases, so trees using least memory go first.
+        std::vector<result> results;
+        results.push_back(
+            time_tree<compact_tree<int>>("compact_tree", keys, erase_order));
+        using pooled_avl_tree = tree<int, avl_balancing, pool_allocator<int>>;
+        results.push_back(time_tree<pooled_avl_tree>("pooled_avl_tree", keys,
+                                                     erase_order));
+        results.push_back(time_tree<tree<int, avl_balancing>>(
+            "avl_tree", keys, erase_order));
+        results.push_back(time_tree<tree<int, splay_balancing>>(
+            "splay_tree", keys, erase_order));
+        results.push_back(time_tree<tree<int>>("tree", keys, erase_order));
+
+        std::cout << std::fixed << std::setprecision(1);
+        if(format == "json") {
+            print_json(results, size, seed);
+        } else {
+            print_csv(results, size, seed);
+        }
+    }
+} // namespace timing
 
-// First program argument is the size of random generated data (2048 by
-// default).
+// Program arguments are the size of random generated data (2048 by default),
+// `--seed=<number>` making the data reproducible and `--timing=json` or
+// `--timing=csv`, which measures trees instead of testing them.
 int main(int argc, char* argv[]) {
     std::size_t test_vector_size = 2'048;
-    if(argc >= 2) {
+    std::optional<std::mt19937::result_type> seed;
+    std::string timing_format;
+
+    for(int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
         try {
-            test_vector_size = std::stoull(argv[1]);
+            if(argument.rfind("--seed=", 0) == 0) {
+                seed = static_cast<std::mt19937::result_type>(
+                    std::stoul(argument.substr(7)));
+            } else if(argument.rfind("--timing=", 0) == 0) {
+                timing_format = argument.substr(9);
+                if(timing_format != "json" && timing_format != "csv") {
+                    timing_format.clear();
+                    throw std::invalid_argument("unknown timing format");
+                }
+            } else {
+                test_vector_size = std::stoull(argument);
+            }
         } catch(std::exception& e) {
-            std::cerr << "Invalid program argument: " << e.what() << ".\n";
-            std::cerr << "The size of random generated data will be "
-                      << test_vector_size << ".\n";
+            std::cerr << "Invalid program argument " << argument << ": "
+                      << e.what() << ".\n";
+            std::cerr << "The argument is ignored.\n";
         }
     }
 
-    std::vector<int> test_vector = generate_test_vector(test_vector_size);
-
-    tree<int> test_tree;
-    for(int e : test_vector) {
-        test_tree.insert(e);
-    }
-
-    assert(test_vector.size() == test_tree.size());
-    std::cout << "Tree was successfully filled with values from 0 to "
-              << test_vector_size << '.' << std::endl;
+    const std::mt19937::result_type seed_value =
+        seed.value_or(std::random_device{}());
+    seed_test_generator(seed_value);
 
-    shuffle_test_vector(test_vector);
-    for(int e : test_vector) {
-        test_tree.erase(e);
+    if(!timing_format.empty()) {
+        try {
+            timing::run(timing_format, test_vector_size, seed_value);
+        } catch(std::exception& e) {
+            std::cerr << "Timing failed: " << e.what() << ".\n";
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
     }
 
-    assert(test_tree.empty() == true);
-    std::cout << "Tree was successfully emptied.\n";
+    std::cout << "Test data is generated with seed " << seed_value << ".\n";
+    std::vector<int> test_vector = generate_test_vector(test_vector_size);
+    fill_and_empty<tree<int>>(test_vector);
+    read_concurrently(test_vector);
+    combine_sets<tree<int, avl_balancing>>(test_vector);
+    // Default-constructed pooled trees have different pools.
+    combine_sets<tree<int, avl_balancing, pool_allocator<int>>>(test_vector);
+    select_by_position<tree<int, order_statistics<avl_balancing>>>(test_vector);
+    look_up_strings<ordered_tree<std::string, std::less<>, avl_balancing>>(
+        test_vector);
+    move_nodes<tree<int, avl_balancing, pool_allocator<int>>>(test_vector);
+    fill_and_empty<tree<int, splay_balancing>>(test_vector);
+    store_compactly(test_vector);
+    access_repeatedly<
+        tree<int, splay_balancing, std::allocator<int>, tree_stats>>(
+        test_vector);
+
+    // Sorted input is the worst case for the unbalanced tree.
+    std::sort(test_vector.begin(), test_vector.end());
+    fill_and_empty<tree<int, avl_balancing>>(test_vector);
+    combine_sets<tree<int>>(test_vector);
+    combine_sets<tree<int, splay_balancing>>(test_vector);
+    assign_sorted<tree<int, avl_balancing>>(test_vector);
+    mutate_in_batches<tree<int, avl_balancing, pool_allocator<int>>>(
+        test_vector);
+    mutate_in_batches<tree<int>>(test_vector);
+    collect_stats<tree<int, avl_balancing, std::allocator<int>, tree_stats>>(
+        test_vector);
+    fill_and_empty<tree<int, avl_balancing, pool_allocator<int>>>(test_vector);
 }
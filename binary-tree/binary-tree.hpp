@@ -0,0 +1,2980 @@
+// Author: Jakub Mazurkiewicz
+// C++ standard: 17
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#    include <intrin.h>
+#endif
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#    include <xmmintrin.h>
+#endif
+#if defined(_WIN32)
+#    ifndef NOMINMAX
+#        define NOMINMAX
+#    endif
+#    ifndef WIN32_LEAN_AND_MEAN
+#        define WIN32_LEAN_AND_MEAN
+#    endif
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+// Hints the processor to start loading memory which will be read soon.
+inline void prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+    static_cast<void>(address);
+#endif
+}
+
+// Returns number of trailing one bits of `bits` (which can't be all ones).
+inline unsigned count_trailing_ones(std::size_t bits) {
+    const std::size_t zeros = ~bits;
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(zeros));
+#elif defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, zeros);
+    return index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, zeros);
+    return index;
+#else
+    unsigned count = 0;
+    while(((bits >> count) & 1) != 0) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+// Number of lookups interleaved by `contains_batch` functions, so memory
+// accesses of one lookup overlap with comparisons of the other ones.
+inline constexpr std::size_t batch_group_size = 8;
+
+// Statistics collected by the tree; see `tree::stats`.
+struct tree_statistics {
+    std::uint64_t comparisons = 0;
+    std::uint64_t allocations = 0;
+    std::uint64_t deallocations = 0;
+    std::uint64_t rotations = 0;
+    std::size_t max_depth = 0;
+    double average_depth = 0.0;
+};
+
+// Statistics policies of the tree. The default one counts nothing, so calls
+// to it compile to nothing.
+struct no_stats {
+    void count_comparison() const { }
+    void count_allocation() const { }
+    void count_deallocation() const { }
+    void count_rotation() const { }
+
+    tree_statistics snapshot() const {
+        return {};
+    }
+};
+
+// Counts events with relaxed atomics, so lookups running concurrently and
+// parallel set operations are counted correctly.
+class tree_stats {
+public:
+    void count_comparison() const {
+        increment(comparisons);
+    }
+
+    void count_allocation() const {
+        increment(allocations);
+    }
+
+    void count_deallocation() const {
+        increment(deallocations);
+    }
+
+    void count_rotation() const {
+        increment(rotations);
+    }
+
+    tree_statistics snapshot() const {
+        tree_statistics result;
+        result.comparisons = comparisons.load(std::memory_order_relaxed);
+        result.allocations = allocations.load(std::memory_order_relaxed);
+        result.deallocations = deallocations.load(std::memory_order_relaxed);
+        result.rotations = rotations.load(std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    using counter = std::atomic<std::uint64_t>;
+
+    mutable counter comparisons{0};
+    mutable counter allocations{0};
+    mutable counter deallocations{0};
+    mutable counter rotations{0};
+
+    static void increment(counter& event_counter) {
+        event_counter.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Balancing policies of the tree. Every policy provides `node_data` (extra
+// bookkeeping stored in each node), `update(node)`, which recomputes
+// `node_data` from children of the node, `rebalance(root, node, stats)`,
+// which is called after the subtree of `node` has changed and returns the new
+// root, and `join(left, middle, right, stats)`, which links two detached
+// subtrees with a detached node placed between them and returns root of the
+// result. Rotations are reported to the statistics policy `stats`. Policies
+// call `update` of nodes through `node->update()`, so policies wrapping them
+// (like order_statistics) see every update. `updates_ancestors` tells if
+// `rebalance` updates all nodes on the path from `node` to the root.
+// `balanced` tells if height of the tree is O(log n), so algorithms recursing
+// once per level are safe for large trees. `self_adjusting` tells if lookups
+// restructure the tree; only then
+// `access(root, node, stats)` is called after lookups with the node found or
+// the last one visited (nullptr in empty tree) and returns the new root.
+struct no_balancing {
+    struct node_data { };
+
+    static constexpr bool updates_ancestors = false;
+    static constexpr bool balanced = false;
+    static constexpr bool self_adjusting = false;
+
+    template<typename Node>
+    static void update(Node*) { }
+
+    template<typename Node, typename Stats>
+    static Node* rebalance(Node* root, Node*, const Stats&) {
+        return root;
+    }
+
+    template<typename Node, typename Stats>
+    static Node* join(Node* left, Node* middle, Node* right, const Stats&) {
+        middle->attach_on_left(left);
+        middle->attach_on_right(right);
+        middle->update();
+        return middle;
+    }
+};
+
+template<typename T, typename Balancing = no_balancing>
+struct tree_node : Balancing::node_data {
+    template<typename... Args>
+    tree_node(Args&&... args)
+        : value(std::forward<Args>(args)...)
+        , parent{nullptr}
+        , left{nullptr}
+        , right{nullptr} { }
+
+    T value;
+
+    tree_node* parent;
+    tree_node* left;
+    tree_node* right;
+
+    // Recomputes balancing data of this node from its children.
+    void update() {
+        Balancing::update(this);
+    }
+
+    void attach_on_left(tree_node* new_left) {
+        left = new_left;
+        if(new_left != nullptr) {
+            new_left->parent = this;
+        }
+    }
+
+    void attach_on_right(tree_node* new_right) {
+        right = new_right;
+        if(new_right != nullptr) {
+            new_right->parent = this;
+        }
+    }
+
+    void replace_child(tree_node* old_child, tree_node* new_child) {
+        if(left == old_child) {
+            attach_on_left(new_child);
+            old_child->parent = nullptr;
+        } else if(right == old_child) {
+            attach_on_right(new_child);
+            old_child->parent = nullptr;
+        }
+    }
+
+    // Rotates subtree rooted at this node to the left and returns its new
+    // root (former right child).
+    tree_node* rotate_left() {
+        tree_node* const pivot = right;
+        replace_in_parent(pivot);
+        attach_on_right(pivot->left);
+        pivot->attach_on_left(this);
+        return pivot;
+    }
+
+    // Rotates subtree rooted at this node to the right and returns its new
+    // root (former left child).
+    tree_node* rotate_right() {
+        tree_node* const pivot = left;
+        replace_in_parent(pivot);
+        attach_on_left(pivot->right);
+        pivot->attach_on_right(this);
+        return pivot;
+    }
+
+private:
+    void replace_in_parent(tree_node* new_node) {
+        if(parent != nullptr) {
+            parent->replace_child(this, new_node);
+        } else {
+            new_node->parent = nullptr;
+        }
+    }
+};
+
+// Keeps the tree height-balanced (AVL tree): heights of subtrees of every node
+// differ by at most one, so depth of the tree is O(log n) for any order of
+// insertions and removals.
+struct avl_balancing {
+    struct node_data {
+        std::uint8_t height = 1;
+    };
+
+    static constexpr bool updates_ancestors = true;
+    static constexpr bool balanced = true;
+    static constexpr bool self_adjusting = false;
+
+    template<typename Node>
+    static void update(Node* node) {
+        node->height = static_cast<std::uint8_t>(
+            1 + std::max(height(node->left), height(node->right)));
+    }
+
+    template<typename Node, typename Stats>
+    static Node* rebalance(Node* root, Node* node, const Stats& stats) {
+        while(node != nullptr) {
+            node = fix_node(node, stats);
+            if(node->parent == nullptr) {
+                return node;
+            }
+            node = node->parent;
+        }
+
+        return root;
+    }
+
+    // The middle node is attached to the spine of the higher subtree at the
+    // level where the heights match, then the spine is rebalanced.
+    template<typename Node, typename Stats>
+    static Node* join(Node* left, Node* middle, Node* right,
+                      const Stats& stats) {
+        if(height(left) > height(right) + 1) {
+            Node* parent = left;
+            while(height(parent->right) > height(right) + 1) {
+                parent = parent->right;
+            }
+
+            middle->attach_on_left(parent->right);
+            middle->attach_on_right(right);
+            middle->update();
+            parent->attach_on_right(middle);
+            return rebalance(left, parent, stats);
+
+        } else if(height(right) > height(left) + 1) {
+            Node* parent = right;
+            while(height(parent->left) > height(left) + 1) {
+                parent = parent->left;
+            }
+
+            middle->attach_on_right(parent->left);
+            middle->attach_on_left(left);
+            middle->update();
+            parent->attach_on_left(middle);
+            return rebalance(right, parent, stats);
+        }
+
+        middle->attach_on_left(left);
+        middle->attach_on_right(right);
+        middle->update();
+        return middle;
+    }
+
+private:
+    template<typename Node>
+    static int height(const Node* node) {
+        return node != nullptr ? node->height : 0;
+    }
+
+    template<typename Node>
+    static int balance_factor(const Node* node) {
+        return height(node->left) - height(node->right);
+    }
+
+    template<typename Node, typename Stats>
+    static Node* rotate_left(Node* node, const Stats& stats) {
+        stats.count_rotation();
+        Node* const pivot = node->rotate_left();
+        node->update();
+        pivot->update();
+        return pivot;
+    }
+
+    template<typename Node, typename Stats>
+    static Node* rotate_right(Node* node, const Stats& stats) {
+        stats.count_rotation();
+        Node* const pivot = node->rotate_right();
+        node->update();
+        pivot->update();
+        return pivot;
+    }
+
+    // Restores balance of `node` (whose children are balanced) and returns
+    // root of its subtree.
+    template<typename Node, typename Stats>
+    static Node* fix_node(Node* node, const Stats& stats) {
+        node->update();
+        const int factor = balance_factor(node);
+
+        if(factor > 1) {
+            if(balance_factor(node->left) < 0) {
+                rotate_left(node->left, stats);
+            }
+            node = rotate_right(node, stats);
+        } else if(factor < -1) {
+            if(balance_factor(node->right) > 0) {
+                rotate_right(node->right, stats);
+            }
+            node = rotate_left(node, stats);
+        }
+
+        return node;
+    }
+};
+
+// Self-adjusting tree (splay tree): every accessed node is moved to the root
+// by rotations, so recently used values are found after few steps and any
+// sequence of operations takes O(log n) amortized time per operation. Lookups
+// restructure the tree, so even they must not run concurrently.
+struct splay_balancing {
+    struct node_data { };
+
+    static constexpr bool updates_ancestors = true;
+    static constexpr bool balanced = false;
+    static constexpr bool self_adjusting = true;
+
+    template<typename Node>
+    static void update(Node*) { }
+
+    // Nodes above `node` are updated by rotations which bring it to the root.
+    template<typename Node, typename Stats>
+    static Node* rebalance(Node* root, Node* node, const Stats& stats) {
+        if(node != nullptr) {
+            node->update();
+        }
+        return access(root, node, stats);
+    }
+
+    template<typename Node, typename Stats>
+    static Node* join(Node* left, Node* middle, Node* right, const Stats&) {
+        middle->attach_on_left(left);
+        middle->attach_on_right(right);
+        middle->update();
+        return middle;
+    }
+
+    template<typename Node, typename Stats>
+    static Node* access(Node* root, Node* node, const Stats& stats) {
+        if(node == nullptr) {
+            return root;
+        }
+
+        while(node->parent != nullptr) {
+            Node* const parent = node->parent;
+            Node* const grandparent = parent->parent;
+            if(grandparent == nullptr) {
+                rotate_up(node, stats);
+            } else if((grandparent->left == parent) ==
+                      (parent->left == node)) {
+                rotate_up(parent, stats);
+                rotate_up(node, stats);
+            } else {
+                rotate_up(node, stats);
+                rotate_up(node, stats);
+            }
+        }
+
+        return node;
+    }
+
+private:
+    // Rotates parent of `node` so `node` takes its place.
+    template<typename Node, typename Stats>
+    static void rotate_up(Node* node, const Stats& stats) {
+        stats.count_rotation();
+        Node* const parent = node->parent;
+        if(parent->left == node) {
+            parent->rotate_right();
+        } else {
+            parent->rotate_left();
+        }
+        parent->update();
+        node->update();
+    }
+};
+
+// Augments nodes of another balancing policy with sizes of their subtrees,
+// so values can be selected by their position and positions of values can
+// be found in O(depth) time (see `tree::nth` and `tree::rank`).
+template<typename Balancing = no_balancing>
+struct order_statistics {
+    struct node_data : Balancing::node_data {
+        std::size_t subtree_size = 1;
+    };
+
+    static constexpr bool updates_ancestors = true;
+    static constexpr bool balanced = Balancing::balanced;
+    static constexpr bool self_adjusting = Balancing::self_adjusting;
+
+    template<typename Node>
+    static void update(Node* node) {
+        Balancing::update(node);
+        node->subtree_size =
+            1 + subtree_size(node->left) + subtree_size(node->right);
+    }
+
+    template<typename Node, typename Stats>
+    static Node* rebalance(Node* root, Node* node, const Stats& stats) {
+        if constexpr(!Balancing::updates_ancestors) {
+            for(Node* ancestor = node; ancestor != nullptr;
+                ancestor = ancestor->parent) {
+                ancestor->update();
+            }
+        }
+
+        return Balancing::rebalance(root, node, stats);
+    }
+
+    template<typename Node, typename Stats>
+    static Node* join(Node* left, Node* middle, Node* right,
+                      const Stats& stats) {
+        return Balancing::join(left, middle, right, stats);
+    }
+
+    template<typename Node, typename Stats>
+    static Node* access(Node* root, Node* node, const Stats& stats) {
+        return Balancing::access(root, node, stats);
+    }
+
+    template<typename Node>
+    static std::size_t subtree_size(const Node* node) {
+        return node != nullptr ? node->subtree_size : 0;
+    }
+};
+
+// Memory pool shared by all copies of a pool_allocator. Blocks of a single
+// size are carved from slabs (each one twice as big as the previous one) and
+// recycled through an intrusive free list. Slabs are released all at once
+// when the pool is destroyed. Not thread-safe.
+class slab_pool {
+public:
+    static constexpr std::size_t alignment = alignof(std::max_align_t);
+
+    slab_pool() = default;
+    slab_pool(const slab_pool&) = delete;
+    slab_pool& operator=(const slab_pool&) = delete;
+
+    // Size of blocks is chosen on first allocation. Requests of any other
+    // size are forwarded to the global operator new.
+    void* allocate(std::size_t bytes) {
+        bytes = round_up(bytes);
+        if(block_size == 0) {
+            block_size = bytes;
+        }
+
+        if(bytes != block_size) {
+            return ::operator new(bytes);
+        }
+
+        if(free_list != nullptr) {
+            return std::exchange(free_list, free_list->next);
+        }
+
+        if(cursor == slab_end) {
+            add_slab();
+        }
+
+        return std::exchange(cursor, cursor + block_size);
+    }
+
+    void deallocate(void* block, std::size_t bytes) {
+        if(round_up(bytes) != block_size) {
+            ::operator delete(block);
+        } else {
+            free_list = ::new(block) free_block{free_list};
+        }
+    }
+
+private:
+    struct free_block {
+        free_block* next;
+    };
+
+    std::size_t block_size = 0;
+    std::size_t next_slab_blocks = 32;
+    std::vector<std::unique_ptr<std::max_align_t[]>> slabs;
+    unsigned char* cursor = nullptr;
+    unsigned char* slab_end = nullptr;
+    free_block* free_list = nullptr;
+
+    static std::size_t round_up(std::size_t bytes) {
+        bytes = std::max(bytes, sizeof(free_block));
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+
+    void add_slab() {
+        const std::size_t slab_size = next_slab_blocks * block_size;
+        slabs.emplace_back(
+            new std::max_align_t[slab_size / sizeof(std::max_align_t)]);
+
+        cursor = reinterpret_cast<unsigned char*>(slabs.back().get());
+        slab_end = cursor + slab_size;
+        next_slab_blocks *= 2;
+    }
+};
+
+// Allocator for node-based containers. Single objects come from a slab_pool
+// shared by all (also rebound) copies of the allocator; arrays are allocated
+// with std::allocator.
+template<typename T>
+class pool_allocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    pool_allocator()
+        : pool{std::make_shared<slab_pool>()} { }
+
+    // Moving copies the pool pointer, so moved-from allocator stays usable.
+    pool_allocator(const pool_allocator&) noexcept = default;
+    pool_allocator& operator=(const pool_allocator&) noexcept = default;
+
+    template<typename U>
+    pool_allocator(const pool_allocator<U>& other) noexcept
+        : pool{other.pool} { }
+
+    T* allocate(std::size_t n) {
+        if(n == 1 && alignof(T) <= slab_pool::alignment) {
+            return static_cast<T*>(pool->allocate(sizeof(T)));
+        }
+
+        return std::allocator<T>{}.allocate(n);
+    }
+
+    void deallocate(T* pointer, std::size_t n) {
+        if(n == 1 && alignof(T) <= slab_pool::alignment) {
+            pool->deallocate(pointer, sizeof(T));
+        } else {
+            std::allocator<T>{}.deallocate(pointer, n);
+        }
+    }
+
+    // Returns true if no other allocator shares the pool, so releasing this
+    // allocator releases all memory allocated by it.
+    bool is_exclusive() const noexcept {
+        return pool.use_count() == 1;
+    }
+
+    template<typename U>
+    bool operator==(const pool_allocator<U>& other) const noexcept {
+        return pool == other.pool;
+    }
+
+    template<typename U>
+    bool operator!=(const pool_allocator<U>& other) const noexcept {
+        return !(*this == other);
+    }
+
+private:
+    template<typename>
+    friend class pool_allocator;
+
+    std::shared_ptr<slab_pool> pool;
+};
+
+template<typename Allocator>
+struct is_pool_allocator : std::false_type { };
+
+template<typename T>
+struct is_pool_allocator<pool_allocator<T>> : std::true_type { };
+
+// Values are ordered by `Compare`. If it has `is_transparent` member type
+// (like std::less<>), lookups accept any type comparable with values, so for
+// example a tree of std::string ordered by std::less<> looks up string views
+// without creating temporary strings.
+template<typename T, typename Balancing = no_balancing,
+         typename Allocator = std::allocator<T>, typename Stats = no_stats,
+         typename Compare = std::less<T>>
+class tree {
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using allocator_type = Allocator;
+    using key_compare = Compare;
+
+private:
+    using node = tree_node<value_type, Balancing>;
+    using node_ptr = node*;
+    using node_allocator_type = typename std::allocator_traits<
+        allocator_type>::template rebind_alloc<node>;
+    using node_allocator_traits = std::allocator_traits<node_allocator_type>;
+
+    // Self-adjusting balancing policies restructure the tree on lookups.
+    mutable node_ptr root;
+    size_type tree_size;
+    node_allocator_type allocator;
+    mutable Stats statistics;
+    key_compare compare;
+
+public:
+    tree()
+        : tree(allocator_type()) { }
+
+    explicit tree(const allocator_type& allocator)
+        : tree(key_compare(), allocator) { }
+
+    explicit tree(const key_compare& compare,
+                  const allocator_type& allocator = allocator_type())
+        : root{nullptr}
+        , tree_size{0}
+        , allocator(allocator)
+        , compare(compare) { }
+
+    tree(const tree&) = delete;
+    tree& operator=(const tree&) = delete;
+
+    tree(tree&& other) noexcept
+        : root{std::exchange(other.root, nullptr)}
+        , tree_size{std::exchange(other.tree_size, 0)}
+        , allocator(std::move(other.allocator))
+        , compare(other.compare) { }
+
+    tree& operator=(tree&& other) noexcept(
+        node_allocator_traits::propagate_on_container_move_assignment::value ||
+        node_allocator_traits::is_always_equal::value) {
+        if(&other != this) {
+            clear();
+
+            compare = other.compare;
+            if constexpr(node_allocator_traits::
+                             propagate_on_container_move_assignment::value) {
+                allocator = std::move(other.allocator);
+                steal_nodes(other);
+            } else if(allocator == other.allocator) {
+                steal_nodes(other);
+            } else {
+                // Nodes can't be handed over between different allocators.
+                for(iterator it = other.begin(); it != other.end(); ++it) {
+                    emplace(std::move(it.current->value));
+                }
+                other.clear();
+            }
+        }
+
+        return *this;
+    }
+
+    ~tree() {
+        if(!empty() && !can_release_in_bulk()) {
+            remove_subtree(root);
+        }
+    }
+
+    void swap(tree& other) noexcept {
+        using propagate = typename node_allocator_traits::
+            propagate_on_container_swap;
+
+        if constexpr(propagate::value) {
+            using std::swap;
+            swap(allocator, other.allocator);
+        } else {
+            assert(allocator == other.allocator);
+        }
+
+        using std::swap;
+        swap(compare, other.compare);
+        std::swap(root, other.root);
+        std::swap(tree_size, other.tree_size);
+    }
+
+    friend void swap(tree& first, tree& second) noexcept {
+        first.swap(second);
+    }
+
+    allocator_type get_allocator() const {
+        return allocator_type(allocator);
+    }
+
+    key_compare key_comp() const {
+        return compare;
+    }
+
+    // Bidirectional iterator visiting values in ascending order. Values of
+    // the tree are immutable.
+    class iterator {
+    public:
+        using value_type = T;
+        using reference = const value_type&;
+        using pointer = const value_type*;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::bidirectional_iterator_tag;
+
+        iterator()
+            : owner{nullptr}
+            , current{nullptr} { }
+
+        reference operator*() const {
+            return current->value;
+        }
+
+        pointer operator->() const {
+            return &current->value;
+        }
+
+        iterator& operator++() {
+            current = successor(current);
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        // Decrementing end() gives the last value.
+        iterator& operator--() {
+            current = (current != nullptr ? predecessor(current)
+                                          : rightmost(owner->root));
+            return *this;
+        }
+
+        iterator operator--(int) {
+            iterator copy = *this;
+            --*this;
+            return copy;
+        }
+
+        bool operator==(const iterator& other) const {
+            return current == other.current;
+        }
+
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class tree;
+
+        iterator(const tree* owner, node_ptr current)
+            : owner{owner}
+            , current{current} { }
+
+        const tree* owner;
+        node_ptr current;
+    };
+
+    using const_iterator = iterator;
+
+    iterator begin() const {
+        return make_iterator(empty() ? nullptr : leftmost(root));
+    }
+
+    iterator end() const {
+        return make_iterator(nullptr);
+    }
+
+private:
+    iterator make_iterator(node_ptr node) const {
+        return iterator{this, node};
+    }
+
+public:
+    iterator find(const value_type& value) const {
+        return make_iterator(look_up(value));
+    }
+
+    template<typename Key, typename C = key_compare,
+             typename = typename C::is_transparent>
+    iterator find(const Key& key) const {
+        return make_iterator(look_up(key));
+    }
+
+    // Returns iterator to the first value not less than `value`.
+    iterator lower_bound(const value_type& value) const {
+        node_ptr result = nullptr;
+
+        for(node_ptr subtree = root; subtree != nullptr;) {
+            if(less(subtree->value, value)) {
+                subtree = subtree->right;
+            } else {
+                result = subtree;
+                subtree = subtree->left;
+            }
+        }
+
+        return make_iterator(result);
+    }
+
+    // Returns iterator to the first value greater than `value`.
+    iterator upper_bound(const value_type& value) const {
+        node_ptr result = nullptr;
+
+        for(node_ptr subtree = root; subtree != nullptr;) {
+            if(less(value, subtree->value)) {
+                result = subtree;
+                subtree = subtree->left;
+            } else {
+                subtree = subtree->right;
+            }
+        }
+
+        return make_iterator(result);
+    }
+
+    // Returns iterator to the value preceded by `k` other ones, or end() if
+    // `k` is not less than size(). Requires order_statistics balancing.
+    iterator nth(size_type k) const {
+        node_ptr node = root;
+
+        while(node != nullptr) {
+            const size_type left_size = Balancing::subtree_size(node->left);
+            if(k < left_size) {
+                node = node->left;
+            } else if(k > left_size) {
+                k -= left_size + 1;
+                node = node->right;
+            } else {
+                break;
+            }
+        }
+
+        return make_iterator(node);
+    }
+
+    // Returns number of values less than `value`. Requires order_statistics
+    // balancing.
+    size_type rank(const value_type& value) const {
+        size_type result = 0;
+
+        for(node_ptr node = root; node != nullptr;) {
+            if(less(node->value, value)) {
+                result += Balancing::subtree_size(node->left) + 1;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+
+        return result;
+    }
+
+    std::pair<iterator, iterator> equal_range(const value_type& value) const {
+        const iterator first = lower_bound(value);
+        if(first != end() && !less(value, *first)) {
+            return {first, std::next(first)};
+        }
+
+        return {first, first};
+    }
+
+private:
+    template<typename... Args>
+    node_ptr create_node(Args&&... args) {
+        const node_ptr new_node = node_allocator_traits::allocate(allocator, 1);
+        statistics.count_allocation();
+
+        try {
+            node_allocator_traits::construct(allocator, new_node,
+                                             std::forward<Args>(args)...);
+        } catch(...) {
+            node_allocator_traits::deallocate(allocator, new_node, 1);
+            statistics.count_deallocation();
+            throw;
+        }
+
+        return new_node;
+    }
+
+    void destroy_node(node_ptr node_to_destroy) {
+        node_allocator_traits::destroy(allocator, node_to_destroy);
+        node_allocator_traits::deallocate(allocator, node_to_destroy, 1);
+        statistics.count_deallocation();
+    }
+
+    void steal_nodes(tree& other) {
+        root = std::exchange(other.root, nullptr);
+        tree_size = std::exchange(other.tree_size, 0);
+    }
+
+    // Nodes which need no destruction don't have to be visited one by one if
+    // the tree is the only owner of the pool they come from.
+    bool can_release_in_bulk() const {
+        if constexpr(std::is_trivially_destructible_v<node> &&
+                     is_pool_allocator<node_allocator_type>::value) {
+            return allocator.is_exclusive();
+        } else {
+            return false;
+        }
+    }
+
+    // Walks down to leaves and deletes them on the way back using parent
+    // pointers, so teardown needs neither recursion nor extra memory.
+    // Returns number of removed nodes.
+    size_type remove_subtree(node_ptr node) {
+        const node_ptr stop = node->parent;
+        size_type count = 0;
+
+        while(node != stop) {
+            if(node->left != nullptr) {
+                node = node->left;
+            } else if(node->right != nullptr) {
+                node = node->right;
+            } else {
+                const node_ptr parent = node->parent;
+                if(parent != nullptr) {
+                    (parent->left == node ? parent->left : parent->right) =
+                        nullptr;
+                }
+
+                destroy_node(node);
+                node = parent;
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+public:
+    size_type size() const {
+        return tree_size;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Returns counters of the statistics policy (zeros for no_stats) and
+    // depths of the current nodes, root having depth one. Depths are computed
+    // by visiting every node. Counters belong to the tree object, moves and
+    // swaps don't transfer them.
+    tree_statistics stats() const {
+        tree_statistics result = statistics.snapshot();
+        std::uint64_t depth_sum = 0;
+        std::size_t depth = 1;
+
+        for(node_ptr node = root, previous = nullptr; node != nullptr;) {
+            node_ptr next;
+            if(previous == node->parent) {
+                depth_sum += depth;
+                result.max_depth = std::max(result.max_depth, depth);
+                next = node->left != nullptr    ? node->left
+                       : node->right != nullptr ? node->right
+                                                : node->parent;
+            } else if(previous == node->left && node->right != nullptr) {
+                next = node->right;
+            } else {
+                next = node->parent;
+            }
+
+            depth = (next == node->parent ? depth - 1 : depth + 1);
+            previous = std::exchange(node, next);
+        }
+
+        if(!empty()) {
+            result.average_depth = static_cast<double>(depth_sum) /
+                                   static_cast<double>(size());
+        }
+        return result;
+    }
+
+    bool insert(const value_type& value) {
+        return try_emplace(value).second;
+    }
+
+    template<typename... Args>
+    bool emplace(Args&&... args) {
+        const node_ptr new_node = create_node(std::forward<Args>(args)...);
+        const insert_position position = find_insert_position(new_node->value);
+
+        if(position.existing != nullptr) {
+            destroy_node(new_node);
+            return false;
+        }
+
+        try_insert(position, new_node);
+        return true;
+    }
+
+    // Constructs value from `args` (or copies `key` if there are none) only if
+    // the tree holds no value equivalent to `key`, so hitting an existing
+    // value costs no allocation. Constructed value must be equivalent to
+    // `key`.
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const value_type& key,
+                                          Args&&... args) {
+        const insert_position position = find_insert_position(key);
+        if(position.existing != nullptr) {
+            return {make_iterator(position.existing), false};
+        }
+
+        node_ptr new_node;
+        if constexpr(sizeof...(Args) == 0) {
+            new_node = create_node(key);
+        } else {
+            new_node = create_node(std::forward<Args>(args)...);
+        }
+
+        try_insert(position, new_node);
+        return {make_iterator(new_node), true};
+    }
+
+    // Inserts value or replaces the equivalent one already stored.
+    std::pair<iterator, bool> insert_or_assign(const value_type& value) {
+        const insert_position position = find_insert_position(value);
+        if(position.existing != nullptr) {
+            position.existing->value = value;
+            return {make_iterator(position.existing), false};
+        }
+
+        const node_ptr new_node = create_node(value);
+        try_insert(position, new_node);
+        return {make_iterator(new_node), true};
+    }
+
+private:
+    // Result of a descent looking for value: either node with equivalent
+    // value or parent (nullptr if tree is empty) of the free slot where the
+    // value belongs.
+    struct insert_position {
+        node_ptr existing;
+        node_ptr parent;
+        bool on_left;
+    };
+
+    insert_position find_insert_position(const value_type& value) const {
+        insert_position position{nullptr, nullptr, false};
+
+        for(node_ptr subtree = root; subtree != nullptr;) {
+            position.parent = subtree;
+
+            if(less(value, subtree->value)) {
+                position.on_left = true;
+                subtree = subtree->left;
+            } else if(less(subtree->value, value)) {
+                position.on_left = false;
+                subtree = subtree->right;
+            } else {
+                position.existing = subtree;
+                break;
+            }
+        }
+
+        return position;
+    }
+
+    void try_insert(const insert_position& position, node_ptr new_node) {
+        if(position.parent == nullptr) {
+            root = new_node;
+        } else if(position.on_left) {
+            position.parent->attach_on_left(new_node);
+        } else {
+            position.parent->attach_on_right(new_node);
+        }
+
+        root = Balancing::rebalance(root, new_node, statistics);
+        ++tree_size;
+    }
+
+public:
+    // Stores `contains(values[i])` in `results[i]` for every i less than
+    // `count`. Descents of a group of values advance in lockstep and nodes for
+    // the next step are prefetched.
+    void contains_batch(const value_type* values, size_type count,
+                        bool* results) const {
+        for(size_type first = 0; first < count; first += batch_group_size) {
+            const size_type lanes = std::min(batch_group_size, count - first);
+            const value_type* const group_values = values + first;
+            bool* const group_results = results + first;
+
+            node_ptr nodes[batch_group_size];
+            std::fill_n(nodes, lanes, root);
+            std::fill_n(group_results, lanes, false);
+
+            for(bool active = true; active;) {
+                active = false;
+
+                for(size_type lane = 0; lane < lanes; ++lane) {
+                    node_ptr& node = nodes[lane];
+                    if(node == nullptr) {
+                        continue;
+                    }
+
+                    const value_type& value = group_values[lane];
+                    if(less(value, node->value)) {
+                        node = node->left;
+                    } else if(less(node->value, value)) {
+                        node = node->right;
+                    } else {
+                        group_results[lane] = true;
+                        node = nullptr;
+                    }
+
+                    if(node != nullptr) {
+                        prefetch(node);
+                        active = true;
+                    }
+                }
+            }
+        }
+    }
+
+    void clear() {
+        if(!empty()) {
+            remove_subtree(root);
+            root = nullptr;
+            tree_size = 0;
+        }
+    }
+
+    // Replaces contents of the tree with values from sorted range without
+    // equivalent values. Builds perfectly balanced tree in linear time;
+    // nodes are allocated in ascending order of values, so with
+    // pool_allocator they end up next to each other in memory.
+    template<typename ForwardIt>
+    void assign_sorted(ForwardIt first, ForwardIt last) {
+        assert(std::adjacent_find(
+                   first, last, [&](const value_type& a, const value_type& b) {
+                       return !compare(a, b);
+                   }) == last);
+
+        clear();
+
+        const size_type count = std::distance(first, last);
+        node_ptr chain = create_chain(first, last);
+        root = build_balanced(chain, count);
+        if(root != nullptr) {
+            root->parent = nullptr;
+        }
+        tree_size = count;
+    }
+
+private:
+    // Creates nodes linked through `right` pointers in order of the range.
+    template<typename ForwardIt>
+    node_ptr create_chain(ForwardIt first, ForwardIt last) {
+        node_ptr head = nullptr;
+        node_ptr* tail = &head;
+
+        try {
+            for(; first != last; ++first) {
+                *tail = create_node(*first);
+                tail = &(*tail)->right;
+            }
+        } catch(...) {
+            while(head != nullptr) {
+                destroy_node(std::exchange(head, head->right));
+            }
+            throw;
+        }
+
+        return head;
+    }
+
+    // Builds balanced tree of first `count` nodes of the chain and advances
+    // the chain past them.
+    node_ptr build_balanced(node_ptr& chain, size_type count) {
+        if(count == 0) {
+            return nullptr;
+        }
+
+        const node_ptr left = build_balanced(chain, count / 2);
+        const node_ptr middle = std::exchange(chain, chain->right);
+
+        middle->attach_on_left(left);
+        middle->attach_on_right(build_balanced(chain, count - count / 2 - 1));
+        middle->update();
+        return middle;
+    }
+
+public:
+    // Set operations move nodes of `other` into this tree and leave `other`
+    // empty. With balanced policies they split and join subtrees, so no node
+    // is allocated unless allocators of both trees differ (then values of
+    // `other` are moved into new nodes first); independent subtrees of large
+    // trees are processed in parallel. Splitting recurses once per level, so
+    // other policies, whose trees may degenerate into lists, move and erase
+    // values one by one instead. Comparisons must not throw.
+    void union_with(tree& other) {
+        if(&other != this) {
+            if constexpr(Balancing::balanced) {
+                combine(other, &tree::unite);
+            } else {
+                insert_one_by_one(other);
+            }
+        }
+    }
+
+    void intersect_with(tree& other) {
+        if(&other != this) {
+            if constexpr(Balancing::balanced) {
+                combine(other, &tree::intersect);
+            } else {
+                intersect_one_by_one(other);
+            }
+        }
+    }
+
+    void difference_with(tree& other) {
+        if(&other != this) {
+            if constexpr(Balancing::balanced) {
+                combine(other, &tree::subtract);
+            } else {
+                subtract_one_by_one(other);
+            }
+        } else {
+            clear();
+        }
+    }
+
+    // Inserts values of the range, skipping ones already in the tree. With
+    // balanced policies, values already stored are dropped first, nodes of
+    // the other ones are built into a balanced tree and it is united with
+    // this one, so no node is allocated in vain.
+    template<typename InputIt>
+    void insert_batch(InputIt first, InputIt last) {
+        if constexpr(Balancing::balanced) {
+            std::vector<value_type> values(first, last);
+            sort_unique(values);
+            values.erase(std::remove_if(values.begin(), values.end(),
+                                        [this](const value_type& value) {
+                                            return find_at(root, value) !=
+                                                   nullptr;
+                                        }),
+                         values.end());
+
+            node_ptr chain =
+                create_chain(std::make_move_iterator(values.begin()),
+                             std::make_move_iterator(values.end()));
+            const node_ptr batch_root = build_balanced(chain, values.size());
+            if(batch_root != nullptr) {
+                batch_root->parent = nullptr;
+            }
+
+            const size_type total_size = size() + values.size();
+            adopt(unite(std::exchange(root, nullptr), batch_root,
+                        parallel_work::of(total_size)),
+                  total_size);
+        } else {
+            for(; first != last; ++first) {
+                const value_type& value = *first;
+                try_emplace(value);
+            }
+        }
+    }
+
+    // Erases values of the range. With balanced policies it is done in one
+    // pass: the tree is split at the middle value of the sorted batch and
+    // both halves are processed (in parallel if they are large) with
+    // respective parts of the batch. Erased nodes are destroyed together at
+    // the end. Other policies erase values one by one, since splitting
+    // recurses once per level. Comparisons must not throw.
+    template<typename InputIt>
+    void erase_batch(InputIt first, InputIt last) {
+        if constexpr(Balancing::balanced) {
+            std::vector<value_type> values(first, last);
+            sort_unique(values);
+
+            const set_result result =
+                erase_sorted(std::exchange(root, nullptr), values.data(),
+                             values.size(),
+                             parallel_work::of(size() + values.size()));
+            adopt(result, size());
+        } else {
+            for(; first != last; ++first) {
+                const value_type& value = *first;
+                erase_node(look_up(value));
+            }
+        }
+    }
+
+private:
+    // Subtrees waiting for destruction, linked through `parent` pointers of
+    // their roots.
+    struct discarded_nodes {
+        node_ptr head = nullptr;
+        node_ptr tail = nullptr;
+
+        void push(node_ptr subtree) {
+            if(subtree != nullptr) {
+                subtree->parent = head;
+                head = subtree;
+                if(tail == nullptr) {
+                    tail = subtree;
+                }
+            }
+        }
+
+        void splice(const discarded_nodes& other) {
+            if(other.head != nullptr) {
+                other.tail->parent = head;
+                head = other.head;
+                if(tail == nullptr) {
+                    tail = other.tail;
+                }
+            }
+        }
+    };
+
+    struct set_result {
+        node_ptr root = nullptr;
+        discarded_nodes discarded;
+    };
+
+    struct split_result {
+        node_ptr left = nullptr;
+        node_ptr found = nullptr;
+        node_ptr right = nullptr;
+    };
+
+    // Estimated number of nodes below which subtrees are not worth a thread.
+    static constexpr size_type parallel_threshold = 1 << 15;
+
+    template<typename Operation>
+    void combine(tree& other, Operation operation) {
+        if(!(allocator == other.allocator)) {
+            // Nodes can't be handed over between different allocators, so
+            // values of `other` are moved into nodes of this one first.
+            std::vector<value_type> values;
+            values.reserve(other.size());
+            for(iterator it = other.begin(); it != other.end(); ++it) {
+                values.push_back(std::move(it.current->value));
+            }
+            other.clear();
+
+            tree moved(compare, get_allocator());
+            moved.assign_sorted(std::make_move_iterator(values.begin()),
+                                std::make_move_iterator(values.end()));
+            combine(moved, operation);
+            return;
+        }
+
+        const size_type total_size = size() + other.size();
+        const set_result result =
+            (this->*operation)(std::exchange(root, nullptr),
+                               std::exchange(other.root, nullptr),
+                               parallel_work::of(total_size));
+        other.tree_size = 0;
+        adopt(result, total_size);
+    }
+
+    // Moves nodes of `other` into this tree, or their values if allocators
+    // differ, and destroys the ones with values already stored.
+    void insert_one_by_one(tree& other) {
+        if(!(allocator == other.allocator)) {
+            for(iterator it = other.begin(); it != other.end(); ++it) {
+                try_emplace(it.current->value, std::move(it.current->value));
+            }
+            other.clear();
+            return;
+        }
+
+        while(!other.empty()) {
+            const node_ptr node = other.begin().current;
+            // Extraction can change the root, so it has to be done first.
+            const node_ptr changed_node = other.extract_node(node);
+            other.root = Balancing::rebalance(other.root, changed_node,
+                                              other.statistics);
+            --other.tree_size;
+
+            node->parent = nullptr;
+            node->left = nullptr;
+            node->right = nullptr;
+            const insert_position position = find_insert_position(node->value);
+            if(position.existing != nullptr) {
+                destroy_node(node);
+            } else {
+                try_insert(position, node);
+            }
+        }
+    }
+
+    void intersect_one_by_one(tree& other) {
+        for(iterator it = begin(); it != end();) {
+            const node_ptr node = (it++).current;
+            if(other.look_up(node->value) == nullptr) {
+                erase_node(node);
+            }
+        }
+        other.clear();
+    }
+
+    void subtract_one_by_one(tree& other) {
+        for(iterator it = other.begin(); it != other.end(); ++it) {
+            erase_node(look_up(*it));
+        }
+        other.clear();
+    }
+
+    // Makes result of a set operation on `total_size` nodes the content of
+    // the tree and destroys its discarded nodes.
+    void adopt(const set_result& result, size_type total_size) {
+        root = result.root;
+        tree_size = total_size;
+        for(node_ptr subtree = result.discarded.head; subtree != nullptr;) {
+            const node_ptr next = std::exchange(subtree->parent, nullptr);
+            tree_size -= remove_subtree(subtree);
+            subtree = next;
+        }
+    }
+
+    void sort_unique(std::vector<value_type>& values) const {
+        const auto compare_values = [this](const value_type& first,
+                                           const value_type& second) {
+            return less(first, second);
+        };
+
+        std::sort(values.begin(), values.end(), compare_values);
+        values.erase(std::unique(values.begin(), values.end(),
+                                 [&](const value_type& first,
+                                     const value_type& second) {
+                                     return !compare_values(first, second);
+                                 }),
+                     values.end());
+    }
+
+    // Estimated number of nodes of a set operation and number of times it
+    // may still fork. Forks are limited to about log2 of the number of
+    // cores, so that no more threads than cores are started.
+    struct parallel_work {
+        size_type size = 0;
+        unsigned forks = 0;
+
+        static parallel_work of(size_type size) {
+            static const unsigned fork_limit = [] {
+                unsigned limit = 0;
+                for(unsigned threads = std::thread::hardware_concurrency();
+                    threads > 1; threads = (threads + 1) / 2) {
+                    ++limit;
+                }
+                return limit;
+            }();
+
+            return {size, fork_limit};
+        }
+
+        // Work of each half of the operation, one level deeper.
+        parallel_work half() const {
+            return {size / 2, forks > 0 ? forks - 1 : 0};
+        }
+    };
+
+    // Runs both tasks, the first one on another thread if there is enough
+    // work for both of them and forks are left.
+    template<typename FirstTask, typename SecondTask>
+    static void fork_join(parallel_work work, FirstTask first,
+                          SecondTask second) {
+        std::future<void> first_future;
+        if(work.forks > 0 && work.size >= 2 * parallel_threshold) {
+            try {
+                first_future = std::async(std::launch::async, first);
+            } catch(...) {
+                // The thread was not started (std::system_error) or its
+                // state was not allocated (std::bad_alloc).
+            }
+        }
+        if(!first_future.valid()) {
+            first();
+        }
+
+        second();
+        if(first_future.valid()) {
+            first_future.get();
+        }
+    }
+
+    static std::pair<node_ptr, node_ptr> detach_children(node_ptr node) {
+        const node_ptr left = std::exchange(node->left, nullptr);
+        const node_ptr right = std::exchange(node->right, nullptr);
+
+        if(left != nullptr) {
+            left->parent = nullptr;
+        }
+        if(right != nullptr) {
+            right->parent = nullptr;
+        }
+
+        return {left, right};
+    }
+
+    // Splits detached subtree into values less than `value`, node holding
+    // equivalent value (if any) and values greater than `value`.
+    split_result split(node_ptr subtree, const value_type& value) const {
+        if(subtree == nullptr) {
+            return {};
+        }
+
+        const auto [left, right] = detach_children(subtree);
+
+        if(less(value, subtree->value)) {
+            split_result result = split(left, value);
+            result.right =
+                Balancing::join(result.right, subtree, right, statistics);
+            return result;
+        } else if(less(subtree->value, value)) {
+            split_result result = split(right, value);
+            result.left =
+                Balancing::join(left, subtree, result.left, statistics);
+            return result;
+        }
+
+        return {left, subtree, right};
+    }
+
+    // Joins two detached subtrees without a middle node.
+    node_ptr join(node_ptr left, node_ptr right) const {
+        if(left == nullptr) {
+            return right;
+        }
+
+        const node_ptr last = rightmost(left);
+        const node_ptr rest = std::exchange(last->left, nullptr);
+        if(const node_ptr parent = std::exchange(last->parent, nullptr);
+           parent != nullptr) {
+            parent->attach_on_right(rest);
+            left = Balancing::rebalance(left, parent, statistics);
+        } else {
+            left = rest;
+            if(left != nullptr) {
+                left->parent = nullptr;
+            }
+        }
+
+        return Balancing::join(left, last, right, statistics);
+    }
+
+    set_result unite(node_ptr first, node_ptr second,
+                     parallel_work work) const {
+        if(first == nullptr || second == nullptr) {
+            return {first != nullptr ? first : second, {}};
+        }
+
+        const auto [left, right] = detach_children(first);
+        const split_result pieces = split(second, first->value);
+
+        set_result left_result;
+        set_result right_result;
+        fork_join(
+            work,
+            [&] { left_result = unite(left, pieces.left, work.half()); },
+            [&] { right_result = unite(right, pieces.right, work.half()); });
+
+        set_result result{
+            Balancing::join(left_result.root, first, right_result.root,
+                            statistics),
+            left_result.discarded};
+        result.discarded.splice(right_result.discarded);
+        result.discarded.push(pieces.found);
+        return result;
+    }
+
+    set_result intersect(node_ptr first, node_ptr second,
+                         parallel_work work) const {
+        if(first == nullptr || second == nullptr) {
+            set_result result;
+            result.discarded.push(first);
+            result.discarded.push(second);
+            return result;
+        }
+
+        const auto [left, right] = detach_children(first);
+        const split_result pieces = split(second, first->value);
+
+        set_result left_result;
+        set_result right_result;
+        fork_join(
+            work,
+            [&] { left_result = intersect(left, pieces.left, work.half()); },
+            [&] {
+                right_result = intersect(right, pieces.right, work.half());
+            });
+
+        set_result result{nullptr, left_result.discarded};
+        result.discarded.splice(right_result.discarded);
+        if(pieces.found != nullptr) {
+            result.root =
+                Balancing::join(left_result.root, first, right_result.root,
+                                statistics);
+            result.discarded.push(pieces.found);
+        } else {
+            result.root = join(left_result.root, right_result.root);
+            result.discarded.push(first);
+        }
+        return result;
+    }
+
+    set_result subtract(node_ptr first, node_ptr second,
+                        parallel_work work) const {
+        if(first == nullptr || second == nullptr) {
+            set_result result{first, {}};
+            result.discarded.push(second);
+            return result;
+        }
+
+        const auto [left, right] = detach_children(first);
+        const split_result pieces = split(second, first->value);
+
+        set_result left_result;
+        set_result right_result;
+        fork_join(
+            work,
+            [&] { left_result = subtract(left, pieces.left, work.half()); },
+            [&] {
+                right_result = subtract(right, pieces.right, work.half());
+            });
+
+        set_result result{nullptr, left_result.discarded};
+        result.discarded.splice(right_result.discarded);
+        if(pieces.found != nullptr) {
+            result.root = join(left_result.root, right_result.root);
+            result.discarded.push(pieces.found);
+            result.discarded.push(first);
+        } else {
+            result.root =
+                Balancing::join(left_result.root, first, right_result.root,
+                                statistics);
+        }
+        return result;
+    }
+
+    // Removes values equivalent to `count` sorted `values` from detached
+    // subtree.
+    set_result erase_sorted(node_ptr subtree, const value_type* values,
+                            size_type count, parallel_work work) const {
+        if(subtree == nullptr || count == 0) {
+            return {subtree, {}};
+        }
+
+        const size_type middle = count / 2;
+        const split_result pieces = split(subtree, values[middle]);
+
+        set_result left_result;
+        set_result right_result;
+        fork_join(
+            work,
+            [&] {
+                left_result =
+                    erase_sorted(pieces.left, values, middle, work.half());
+            },
+            [&] {
+                right_result =
+                    erase_sorted(pieces.right, values + middle + 1,
+                                 count - middle - 1, work.half());
+            });
+
+        set_result result{join(left_result.root, right_result.root),
+                          left_result.discarded};
+        result.discarded.splice(right_result.discarded);
+        result.discarded.push(pieces.found);
+        return result;
+    }
+
+public:
+    bool contains(const value_type& value) const {
+        return look_up(value) != nullptr;
+    }
+
+    template<typename Key, typename C = key_compare,
+             typename = typename C::is_transparent>
+    bool contains(const Key& key) const {
+        return look_up(key) != nullptr;
+    }
+
+private:
+    template<typename Key>
+    node_ptr find_at(node_ptr subtree, const Key& key) const {
+        while(subtree != nullptr) {
+            if(less(key, subtree->value)) {
+                subtree = subtree->left;
+            } else if(less(subtree->value, key)) {
+                subtree = subtree->right;
+            } else {
+                break;
+            }
+        }
+
+        return subtree;
+    }
+
+    // Like find_at(root, key), but also tells self-adjusting policies about
+    // the access. Lookups of other policies don't write to the tree, so they
+    // may run concurrently.
+    template<typename Key>
+    node_ptr look_up(const Key& key) const {
+        if constexpr(!Balancing::self_adjusting) {
+            return find_at(root, key);
+        } else {
+            node_ptr last = nullptr;
+            node_ptr subtree = root;
+
+            while(subtree != nullptr) {
+                last = subtree;
+                if(less(key, subtree->value)) {
+                    subtree = subtree->left;
+                } else if(less(subtree->value, key)) {
+                    subtree = subtree->right;
+                } else {
+                    break;
+                }
+            }
+
+            root = Balancing::access(root, last, statistics);
+            return subtree;
+        }
+    }
+
+public:
+    void erase(const value_type& value) {
+        erase_node(find_at(root, value));
+    }
+
+    template<typename Key, typename C = key_compare,
+             typename = typename C::is_transparent>
+    void erase(const Key& key) {
+        erase_node(find_at(root, key));
+    }
+
+private:
+    void erase_node(node_ptr node_to_erase) {
+        if(node_to_erase != nullptr) {
+            // Extraction can change the root, so it has to be done first.
+            const node_ptr changed_node = extract_node(node_to_erase);
+            root = Balancing::rebalance(root, changed_node, statistics);
+            destroy_node(node_to_erase);
+            --tree_size;
+        }
+    }
+
+public:
+    // Owns a node extracted from a tree, so the value can be moved to another
+    // tree with equal allocator without reallocation.
+    class node_type {
+    public:
+        using value_type = T;
+        using allocator_type = Allocator;
+
+        node_type() noexcept
+            : owned{nullptr} { }
+
+        node_type(node_type&& other) noexcept
+            : owned{std::exchange(other.owned, nullptr)}
+            , allocator(std::move(other.allocator)) { }
+
+        node_type& operator=(node_type&& other) noexcept {
+            if(&other != this) {
+                reset();
+                owned = std::exchange(other.owned, nullptr);
+                allocator = std::move(other.allocator);
+            }
+
+            return *this;
+        }
+
+        ~node_type() {
+            reset();
+        }
+
+        bool empty() const noexcept {
+            return owned == nullptr;
+        }
+
+        explicit operator bool() const noexcept {
+            return !empty();
+        }
+
+        // Value may be modified before the node is inserted again.
+        value_type& value() const {
+            return owned->value;
+        }
+
+        allocator_type get_allocator() const {
+            return allocator_type(*allocator);
+        }
+
+    private:
+        friend class tree;
+
+        node_type(node_ptr owned, const node_allocator_type& allocator)
+            : owned{owned}
+            , allocator(allocator) { }
+
+        node_ptr release() {
+            return std::exchange(owned, nullptr);
+        }
+
+        void reset() {
+            if(owned != nullptr) {
+                node_allocator_traits::destroy(*allocator, owned);
+                node_allocator_traits::deallocate(*allocator, owned, 1);
+                owned = nullptr;
+            }
+        }
+
+        node_ptr owned;
+        std::optional<node_allocator_type> allocator;
+    };
+
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        node_type node;
+    };
+
+    node_type extract(iterator position) {
+        const node_ptr node_to_extract = position.current;
+        // Extraction can change the root, so it has to be done first.
+        const node_ptr changed_node = extract_node(node_to_extract);
+        root = Balancing::rebalance(root, changed_node, statistics);
+        --tree_size;
+
+        node_to_extract->parent = nullptr;
+        node_to_extract->left = nullptr;
+        node_to_extract->right = nullptr;
+        return node_type{node_to_extract, allocator};
+    }
+
+    node_type extract(const value_type& value) {
+        const iterator position = find(value);
+        return position != end() ? extract(position) : node_type{};
+    }
+
+    // Inserts node extracted from a tree with equal allocator. If an
+    // equivalent value is already stored, the node is given back.
+    insert_return_type insert(node_type&& handle) {
+        if(handle.empty()) {
+            return {end(), false, node_type{}};
+        }
+
+        assert(allocator == *handle.allocator);
+        const insert_position position =
+            find_insert_position(handle.value());
+        if(position.existing != nullptr) {
+            return {make_iterator(position.existing), false, std::move(handle)};
+        }
+
+        const node_ptr new_node = handle.release();
+        try_insert(position, new_node);
+        return {make_iterator(new_node), true, node_type{}};
+    }
+
+private:
+    // Unlinks node from the tree. Returns the deepest node whose subtree has
+    // changed (nullptr if there is no such node).
+    node_ptr extract_node(node_ptr node) {
+        if(node->left == nullptr && node->right == nullptr) {
+            return extract_leaf(node);
+        } else if(node->left != nullptr && node->right != nullptr) {
+            return extract_double_node(node);
+        } else {
+            return extract_single_node(node);
+        }
+    }
+
+    node_ptr extract_leaf(node_ptr leaf_to_erase) {
+        node_ptr parent = leaf_to_erase->parent;
+        if(parent != nullptr) {
+            parent->replace_child(leaf_to_erase, nullptr);
+        } else {
+            root = nullptr;
+        }
+
+        return parent;
+    }
+
+    node_ptr extract_single_node(node_ptr node_to_erase) {
+        const node_ptr child =
+            (node_to_erase->left != nullptr ? node_to_erase->left
+                                            : node_to_erase->right);
+
+        node_ptr parent = node_to_erase->parent;
+        if(parent != nullptr) {
+            parent->replace_child(node_to_erase, child);
+        } else {
+            root = child;
+            child->parent = nullptr;
+        }
+
+        return parent;
+    }
+
+    node_ptr extract_double_node(node_ptr node_to_erase) {
+        auto [min_node, changed_node] = extract_min_node(node_to_erase->right);
+        if(changed_node == node_to_erase) {
+            changed_node = min_node;
+        }
+
+        if(node_ptr parent = node_to_erase->parent; parent != nullptr) {
+            parent->replace_child(node_to_erase, min_node);
+        } else {
+            root = min_node;
+            min_node->parent = nullptr;
+        }
+
+        min_node->attach_on_left(node_to_erase->left);
+        min_node->attach_on_right(node_to_erase->right);
+        return changed_node;
+    }
+
+    // Returns extracted minimum of the subtree and its former parent.
+    std::pair<node_ptr, node_ptr> extract_min_node(node_ptr subtree) {
+        subtree = leftmost(subtree);
+
+        if(subtree->right != nullptr) {
+            return {subtree, extract_single_node(subtree)};
+        } else {
+            return {subtree, extract_leaf(subtree)};
+        }
+    }
+
+    template<typename First, typename Second>
+    bool less(const First& first, const Second& second) const {
+        statistics.count_comparison();
+        return compare(first, second);
+    }
+
+    static node_ptr leftmost(node_ptr subtree) {
+        while(subtree->left != nullptr) {
+            subtree = subtree->left;
+        }
+
+        return subtree;
+    }
+
+    static node_ptr rightmost(node_ptr subtree) {
+        while(subtree->right != nullptr) {
+            subtree = subtree->right;
+        }
+
+        return subtree;
+    }
+
+    // Returns next node in order (nullptr after the last one).
+    static node_ptr successor(node_ptr node) {
+        if(node->right != nullptr) {
+            return leftmost(node->right);
+        }
+
+        while(node->parent != nullptr && node == node->parent->right) {
+            node = node->parent;
+        }
+
+        return node->parent;
+    }
+
+    // Returns previous node in order (nullptr before the first one).
+    static node_ptr predecessor(node_ptr node) {
+        if(node->left != nullptr) {
+            return rightmost(node->left);
+        }
+
+        while(node->parent != nullptr && node == node->parent->left) {
+            node = node->parent;
+        }
+
+        return node->parent;
+    }
+};
+
+// Tree ordered by `Compare`, which comes right after the value type like in
+// std::set, so other parameters don't have to be spelled out.
+template<typename T, typename Compare, typename Balancing = no_balancing,
+         typename Allocator = std::allocator<T>, typename Stats = no_stats>
+using ordered_tree = tree<T, Balancing, Allocator, Stats, Compare>;
+
+// Whole file mapped read-only into memory.
+class file_mapping {
+public:
+    explicit file_mapping(const std::string& path) {
+#if defined(_WIN32)
+        const HANDLE file =
+            CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE) {
+            throw_last_error("Cannot open " + path);
+        }
+
+        LARGE_INTEGER file_size;
+        if(!GetFileSizeEx(file, &file_size)) {
+            CloseHandle(file);
+            throw_last_error("Cannot get size of " + path);
+        }
+        length = static_cast<std::size_t>(file_size.QuadPart);
+
+        // Views keep the mapping (and the file) open after handles are closed.
+        const HANDLE mapping =
+            length != 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0,
+                                             0, nullptr)
+                        : nullptr;
+        CloseHandle(file);
+        if(length != 0) {
+            if(mapping == nullptr) {
+                throw_last_error("Cannot map " + path);
+            }
+            address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if(address == nullptr) {
+                throw_last_error("Cannot map " + path);
+            }
+        }
+#else
+        const int file = ::open(path.c_str(), O_RDONLY);
+        if(file == -1) {
+            throw_last_error("Cannot open " + path);
+        }
+
+        struct stat file_status;
+        if(::fstat(file, &file_status) == -1) {
+            const int error = errno;
+            ::close(file);
+            throw_error(error, "Cannot get size of " + path);
+        }
+        length = static_cast<std::size_t>(file_status.st_size);
+
+        // The mapping stays valid after the file is closed.
+        if(length != 0) {
+            address = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, file, 0);
+            if(address == MAP_FAILED) {
+                address = nullptr;
+                const int error = errno;
+                ::close(file);
+                throw_error(error, "Cannot map " + path);
+            }
+        }
+        ::close(file);
+#endif
+    }
+
+    file_mapping(const file_mapping&) = delete;
+    file_mapping& operator=(const file_mapping&) = delete;
+
+    ~file_mapping() {
+        if(address != nullptr) {
+#if defined(_WIN32)
+            UnmapViewOfFile(address);
+#else
+            ::munmap(address, length);
+#endif
+        }
+    }
+
+    const unsigned char* data() const {
+        return static_cast<const unsigned char*>(address);
+    }
+
+    std::size_t size() const {
+        return length;
+    }
+
+private:
+    void* address = nullptr;
+    std::size_t length = 0;
+
+#if defined(_WIN32)
+    [[noreturn]] static void throw_last_error(const std::string& message) {
+        throw std::system_error(static_cast<int>(GetLastError()),
+                                std::system_category(), message);
+    }
+#else
+    [[noreturn]] static void throw_last_error(const std::string& message) {
+        throw_error(errno, message);
+    }
+
+    [[noreturn]] static void throw_error(int error,
+                                         const std::string& message) {
+        throw std::system_error(error, std::generic_category(), message);
+    }
+#endif
+};
+
+// Read-only set which keeps its values in a single array in Eytzinger order
+// (children of k-th element are 2k-th and (2k+1)-th ones, counting from one).
+// First levels of the implicit tree share cache lines and the search has no
+// unpredictable branches, so lookups are much faster than in tree.
+template<typename T>
+class frozen_tree {
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+
+private:
+    // Owns the array: a vector for built trees or a mapping of a snapshot.
+    // The array is never modified, so copies of the tree share it.
+    std::shared_ptr<const void> storage;
+    const value_type* values = nullptr;
+    size_type value_count = 0;
+
+public:
+    frozen_tree() = default;
+
+    // Range must be sorted and contain no equivalent values.
+    template<typename ForwardIt>
+    frozen_tree(ForwardIt first, ForwardIt last) {
+        const auto owned_values = std::make_shared<std::vector<value_type>>(
+            std::distance(first, last));
+        value_count = owned_values->size();
+        fill(*owned_values, [&first]() -> decltype(auto) { return *first++; },
+             1);
+
+        values = owned_values->data();
+        storage = owned_values;
+    }
+
+    template<typename Balancing, typename Allocator, typename Stats>
+    explicit frozen_tree(const tree<T, Balancing, Allocator, Stats>& source)
+        : frozen_tree(source.begin(), source.end()) { }
+
+    // Snapshots hold a header followed by the array in Eytzinger order, so
+    // they contain no pointers and can be used right where they are mapped.
+    // Values are copied byte by byte, so snapshots can be read only on
+    // machines with the same byte order and layout of values.
+    void save_snapshot(const std::string& path) const {
+        static_assert(std::is_trivially_copyable_v<value_type>,
+                      "Snapshots require trivially copyable values.");
+
+        snapshot_header header;
+        header.value_count = value_count;
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        const char padding[snapshot_values_offset - sizeof(header)] = {};
+        file.write(padding, sizeof(padding));
+        file.write(reinterpret_cast<const char*>(values),
+                   static_cast<std::streamsize>(value_count *
+                                                sizeof(value_type)));
+        file.close();
+
+        if(!file) {
+            throw std::runtime_error("Cannot write snapshot to " + path);
+        }
+    }
+
+    // Maps snapshot written by save_snapshot; the file isn't read until
+    // lookups touch its pages.
+    static frozen_tree map_snapshot(const std::string& path) {
+        static_assert(std::is_trivially_copyable_v<value_type>,
+                      "Snapshots require trivially copyable values.");
+
+        const auto mapping = std::make_shared<file_mapping>(path);
+
+        snapshot_header header;
+        const snapshot_header expected_header;
+        if(mapping->size() < snapshot_values_offset) {
+            throw std::runtime_error(path + " is not a snapshot");
+        }
+        std::memcpy(&header, mapping->data(), sizeof(header));
+
+        if(std::memcmp(header.magic, expected_header.magic,
+                       sizeof(header.magic)) != 0 ||
+           header.version != expected_header.version ||
+           header.byte_order != expected_header.byte_order ||
+           header.value_size != expected_header.value_size) {
+            throw std::runtime_error(path + " is not a snapshot of this type");
+        }
+        if((mapping->size() - snapshot_values_offset) / sizeof(value_type) <
+           header.value_count) {
+            throw std::runtime_error(path + " is truncated");
+        }
+
+        frozen_tree result;
+        result.value_count = static_cast<size_type>(header.value_count);
+        result.values = reinterpret_cast<const value_type*>(
+            mapping->data() + snapshot_values_offset);
+        result.storage = mapping;
+        return result;
+    }
+
+    size_type size() const {
+        return value_count;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool contains(const value_type& value) const {
+        const size_type index = lower_bound_index(value);
+        return index != 0 && !(value < values_at(index));
+    }
+
+    // Stores `contains(values[i])` in `results[i]` for every i less than
+    // `count`. A group of searches advances level by level; every step
+    // prefetches the cache line holding descendants four levels below.
+    void contains_batch(const value_type* values, size_type count,
+                        bool* results) const {
+        // Levels 0, 1, ..., full_levels - 1 of the implicit tree are complete,
+        // so the search doesn't have to check bounds there.
+        size_type full_levels = 0;
+        while((size_type{2} << full_levels) - 1 <= size()) {
+            ++full_levels;
+        }
+
+        for(size_type first = 0; first < count; first += batch_group_size) {
+            const size_type lanes = std::min(batch_group_size, count - first);
+            const value_type* const group_values = values + first;
+
+            size_type indices[batch_group_size];
+            std::fill_n(indices, lanes, size_type{1});
+
+            for(size_type level = 0; level < full_levels; ++level) {
+                for(size_type lane = 0; lane < lanes; ++lane) {
+                    size_type& k = indices[lane];
+                    k = 2 * k + static_cast<size_type>(values_at(k) <
+                                                      group_values[lane]);
+                    prefetch(&values_at(std::min(16 * k, size())));
+                }
+            }
+
+            for(size_type lane = 0; lane < lanes; ++lane) {
+                size_type& k = indices[lane];
+                if(k <= size()) {
+                    k = 2 * k + static_cast<size_type>(values_at(k) <
+                                                      group_values[lane]);
+                }
+
+                const size_type index = strip_right_turns(k);
+                results[first + lane] =
+                    index != 0 && !(group_values[lane] < values_at(index));
+            }
+        }
+    }
+
+private:
+    // Values start at a cache line boundary of the mapping.
+    static constexpr std::size_t snapshot_values_offset = 64;
+    static_assert(alignof(value_type) <= snapshot_values_offset);
+
+    struct snapshot_header {
+        char magic[8] = {'F', 'R', 'O', 'Z', 'E', 'N', 'T', 'R'};
+        std::uint32_t version = 1;
+        std::uint32_t byte_order = 0x01020304;
+        std::uint64_t value_size = sizeof(value_type);
+        std::uint64_t value_count = 0;
+    };
+
+    const value_type& values_at(size_type k) const {
+        return values[k - 1];
+    }
+
+    // Stores values produced in ascending order by `next` in subtree rooted
+    // at index `k`.
+    template<typename Generator>
+    void fill(std::vector<value_type>& array, Generator&& next, size_type k) {
+        if(k <= size()) {
+            fill(array, next, 2 * k);
+            array[k - 1] = next();
+            fill(array, next, 2 * k + 1);
+        }
+    }
+
+    // Returns index (counting from one) of the first value not less than
+    // `value` or zero if there is no such value.
+    size_type lower_bound_index(const value_type& value) const {
+        size_type k = 1;
+        while(k <= size()) {
+            k = 2 * k + static_cast<size_type>(values_at(k) < value);
+        }
+
+        return strip_right_turns(k);
+    }
+
+    // The search went left for the last time at the answer: drop all right
+    // turns made after it and the left turn itself.
+    static size_type strip_right_turns(size_type k) {
+        return k >> (count_trailing_ones(k) + 1);
+    }
+};
+
+// AVL tree for small trivially copyable values which keeps nodes in one
+// array and links them with 32-bit indices instead of pointers. Nodes have no
+// parent links: operations remember their path from the root and iterators
+// keep a stack of ancestors, so a node of an int takes 16 bytes instead of 32.
+// Erased nodes are reused by later insertions.
+template<typename T>
+class compact_tree {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "compact_tree requires trivially copyable values.");
+
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+
+private:
+    using index_type = std::uint32_t;
+
+    static constexpr index_type null_index =
+        std::numeric_limits<index_type>::max();
+
+    // AVL tree of less than 2^32 nodes is never higher than 46.
+    static constexpr std::size_t max_height = 48;
+
+    struct node {
+        value_type value;
+        index_type left;
+        index_type right;
+        std::uint8_t height;
+    };
+
+    std::vector<node> nodes;
+    index_type root = null_index;
+    // Unused nodes are linked through their `left` indices.
+    index_type free_list = null_index;
+    size_type tree_size = 0;
+
+public:
+    // Forward iterator visiting values in ascending order. Keeps nodes whose
+    // values are yet to be visited on the path to the current one.
+    class iterator {
+    public:
+        using value_type = T;
+        using reference = const value_type&;
+        using pointer = const value_type*;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator() = default;
+
+        reference operator*() const {
+            return owner->nodes[pending[depth - 1]].value;
+        }
+
+        pointer operator->() const {
+            return &**this;
+        }
+
+        iterator& operator++() {
+            const index_type current = pending[--depth];
+            push_leftmost(owner->nodes[current].right);
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const iterator& other) const {
+            return current() == other.current();
+        }
+
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class compact_tree;
+
+        explicit iterator(const compact_tree* owner)
+            : owner{owner} { }
+
+        void push_leftmost(index_type subtree) {
+            for(; subtree != null_index; subtree = owner->nodes[subtree].left) {
+                pending[depth++] = subtree;
+            }
+        }
+
+        index_type current() const {
+            return depth != 0 ? pending[depth - 1] : null_index;
+        }
+
+        const compact_tree* owner = nullptr;
+        index_type pending[max_height] = {};
+        std::size_t depth = 0;
+    };
+
+    using const_iterator = iterator;
+
+    iterator begin() const {
+        iterator result{this};
+        result.push_leftmost(root);
+        return result;
+    }
+
+    iterator end() const {
+        return iterator{this};
+    }
+
+    size_type size() const {
+        return tree_size;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Returns number of nodes on the longest path from the root.
+    size_type height() const {
+        return static_cast<size_type>(height(root));
+    }
+
+    // Makes room for `count` nodes, so insertions don't reallocate the array.
+    void reserve(size_type count) {
+        nodes.reserve(count);
+    }
+
+    void clear() {
+        nodes.clear();
+        root = null_index;
+        free_list = null_index;
+        tree_size = 0;
+    }
+
+    bool contains(const value_type& value) const {
+        index_type subtree = root;
+        while(subtree != null_index) {
+            const node& current = nodes[subtree];
+            if(value < current.value) {
+                subtree = current.left;
+            } else if(current.value < value) {
+                subtree = current.right;
+            } else {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool insert(const value_type& value) {
+        tree_path path(*this);
+        for(index_type subtree = root; subtree != null_index;) {
+            const node& current = nodes[subtree];
+            if(value < current.value) {
+                subtree = path.push(subtree, false);
+            } else if(current.value < value) {
+                subtree = path.push(subtree, true);
+            } else {
+                return false;
+            }
+        }
+
+        // Creating the node can move the array, so the link is found later.
+        const index_type new_node = create_node(value);
+        path.link() = new_node;
+        ++tree_size;
+        retrace(path);
+        return true;
+    }
+
+    void erase(const value_type& value) {
+        tree_path path(*this);
+        index_type subtree = root;
+        while(subtree != null_index) {
+            const node& current = nodes[subtree];
+            if(value < current.value) {
+                subtree = path.push(subtree, false);
+            } else if(current.value < value) {
+                subtree = path.push(subtree, true);
+            } else {
+                break;
+            }
+        }
+
+        if(subtree == null_index) {
+            return;
+        }
+
+        // Node with two children takes value of its successor, which is
+        // removed instead.
+        if(nodes[subtree].left != null_index &&
+           nodes[subtree].right != null_index) {
+            index_type successor = path.push(subtree, true);
+            while(nodes[successor].left != null_index) {
+                successor = path.push(successor, false);
+            }
+            nodes[subtree].value = nodes[successor].value;
+            subtree = successor;
+        }
+
+        const node& removed = nodes[subtree];
+        path.link() = (removed.left != null_index ? removed.left
+                                                  : removed.right);
+        destroy_node(subtree);
+        --tree_size;
+        retrace(path);
+    }
+
+private:
+    // Nodes visited by a descent and directions taken from them.
+    class tree_path {
+    public:
+        explicit tree_path(compact_tree& owner)
+            : owner{owner} { }
+
+        // Returns child of `parent` in the chosen direction.
+        index_type push(index_type parent, bool to_right) {
+            indices[length] = parent;
+            right_turns[length] = to_right;
+            ++length;
+            return child_link(length - 1);
+        }
+
+        bool empty() const {
+            return length == 0;
+        }
+
+        index_type pop() {
+            return indices[--length];
+        }
+
+        // Returns link to the node after the last one of the path.
+        index_type& link() {
+            return length != 0 ? child_link(length - 1) : owner.root;
+        }
+
+    private:
+        index_type& child_link(std::size_t position) {
+            node& parent = owner.nodes[indices[position]];
+            return right_turns[position] ? parent.right : parent.left;
+        }
+
+        compact_tree& owner;
+        index_type indices[max_height];
+        bool right_turns[max_height];
+        std::size_t length = 0;
+    };
+
+    index_type create_node(const value_type& value) {
+        if(free_list != null_index) {
+            const index_type index = free_list;
+            free_list = nodes[index].left;
+            nodes[index] = node{value, null_index, null_index, 1};
+            return index;
+        }
+
+        if(nodes.size() == null_index) {
+            throw std::length_error("compact_tree is full");
+        }
+        nodes.push_back(node{value, null_index, null_index, 1});
+        return static_cast<index_type>(nodes.size() - 1);
+    }
+
+    void destroy_node(index_type index) {
+        nodes[index].left = free_list;
+        free_list = index;
+    }
+
+    // Restores balance of nodes on the path, starting from the last one,
+    // until height of a subtree stays the same.
+    void retrace(tree_path& path) {
+        while(!path.empty()) {
+            const index_type subtree = path.pop();
+            const int old_height = nodes[subtree].height;
+            const index_type new_subtree = fix_node(subtree);
+            path.link() = new_subtree;
+
+            if(nodes[new_subtree].height == old_height) {
+                break;
+            }
+        }
+    }
+
+    int height(index_type index) const {
+        return index != null_index ? nodes[index].height : 0;
+    }
+
+    int balance_factor(index_type index) const {
+        return height(nodes[index].left) - height(nodes[index].right);
+    }
+
+    void update(index_type index) {
+        node& current = nodes[index];
+        current.height = static_cast<std::uint8_t>(
+            1 + std::max(height(current.left), height(current.right)));
+    }
+
+    index_type rotate_left(index_type index) {
+        const index_type pivot = nodes[index].right;
+        nodes[index].right = nodes[pivot].left;
+        nodes[pivot].left = index;
+        update(index);
+        update(pivot);
+        return pivot;
+    }
+
+    index_type rotate_right(index_type index) {
+        const index_type pivot = nodes[index].left;
+        nodes[index].left = nodes[pivot].right;
+        nodes[pivot].right = index;
+        update(index);
+        update(pivot);
+        return pivot;
+    }
+
+    // Restores balance of the node (whose children are balanced) and returns
+    // root of its subtree.
+    index_type fix_node(index_type index) {
+        update(index);
+        const int factor = balance_factor(index);
+
+        if(factor > 1) {
+            if(balance_factor(nodes[index].left) < 0) {
+                nodes[index].left = rotate_left(nodes[index].left);
+            }
+            return rotate_right(index);
+        } else if(factor < -1) {
+            if(balance_factor(nodes[index].right) > 0) {
+                nodes[index].right = rotate_right(nodes[index].right);
+            }
+            return rotate_left(index);
+        }
+
+        return index;
+    }
+};
+
+// Tracks grace periods for concurrent_tree in the style of sleepable RCU.
+// Readers register in one of two counters chosen by the current phase; the
+// writer waits for all readers which might still see unlinked nodes by
+// flipping the phase and waiting until counters of the old one drain (twice,
+// to also cover readers which read the phase right before the flip).
+class epoch_domain {
+public:
+    class reader_guard {
+    public:
+        explicit reader_guard(std::atomic<std::size_t>& counter)
+            : counter{counter} { }
+
+        reader_guard(const reader_guard&) = delete;
+        reader_guard& operator=(const reader_guard&) = delete;
+
+        ~reader_guard() {
+            counter.fetch_sub(1, std::memory_order_release);
+        }
+
+    private:
+        std::atomic<std::size_t>& counter;
+    };
+
+    epoch_domain() = default;
+    epoch_domain(const epoch_domain&) = delete;
+    epoch_domain& operator=(const epoch_domain&) = delete;
+
+    [[nodiscard]] reader_guard enter() {
+        slot& reader_slot = slots[slot_index()];
+        std::atomic<std::size_t>& counter =
+            reader_slot.readers[phase.load(std::memory_order_relaxed)];
+
+        counter.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return reader_guard{counter};
+    }
+
+    // Returns when every reader which entered before the call has left.
+    void synchronize() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        for(int round = 0; round < 2; ++round) {
+            const unsigned old_phase = phase.load(std::memory_order_relaxed);
+            phase.store(old_phase ^ 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            while(!is_drained(old_phase)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    static constexpr std::size_t slot_count = 64;
+
+    // Slots are spread on separate cache lines so readers of different
+    // threads don't contend on counters.
+    struct alignas(64) slot {
+        std::atomic<std::size_t> readers[2] = {};
+    };
+
+    std::atomic<unsigned> phase{0};
+    slot slots[slot_count];
+
+    bool is_drained(unsigned old_phase) const {
+        for(const slot& reader_slot : slots) {
+            if(reader_slot.readers[old_phase].load(std::memory_order_acquire) !=
+               0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static std::size_t slot_index() {
+        static std::atomic<std::size_t> thread_count{0};
+        thread_local const std::size_t index =
+            thread_count.fetch_add(1, std::memory_order_relaxed) % slot_count;
+        return index;
+    }
+};
+
+// Unbalanced binary search tree which allows any number of threads calling
+// `contains` without locking while other threads insert and erase values
+// (modifications are serialized by a mutex). Child pointers are published
+// with release stores, so readers always see fully constructed nodes, and
+// unlinked nodes are freed only after a grace period.
+template<typename T>
+class concurrent_tree {
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+
+private:
+    struct node {
+        explicit node(const value_type& value)
+            : value(value)
+            , left{nullptr}
+            , right{nullptr} { }
+
+        const value_type value;
+        std::atomic<node*> left;
+        std::atomic<node*> right;
+    };
+
+    using node_ptr = node*;
+    using link = std::atomic<node_ptr>;
+
+    // Number of unlinked nodes which triggers their reclamation.
+    static constexpr size_type retired_limit = 64;
+
+    link root;
+    std::atomic<size_type> tree_size;
+    std::mutex writer_mutex;
+    mutable epoch_domain domain;
+    std::vector<node_ptr> retired;
+
+public:
+    concurrent_tree()
+        : root{nullptr}
+        , tree_size{0} { }
+
+    concurrent_tree(const concurrent_tree&) = delete;
+    concurrent_tree& operator=(const concurrent_tree&) = delete;
+
+    // No thread may use the tree during destruction.
+    ~concurrent_tree() {
+        reclaim_retired();
+
+        // Rotating left children up flattens the tree into a list, so it can
+        // be deleted without recursion or extra memory.
+        node_ptr current = root.load(std::memory_order_relaxed);
+        while(current != nullptr) {
+            if(node_ptr left = current->left.load(std::memory_order_relaxed);
+               left != nullptr) {
+                current->left.store(left->right.load(std::memory_order_relaxed),
+                                    std::memory_order_relaxed);
+                left->right.store(current, std::memory_order_relaxed);
+                current = left;
+            } else {
+                delete std::exchange(
+                    current, current->right.load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    size_type size() const {
+        return tree_size.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool contains(const value_type& value) const {
+        [[maybe_unused]] const auto guard = domain.enter();
+
+        node_ptr subtree = root.load(std::memory_order_acquire);
+        while(subtree != nullptr) {
+            if(value < subtree->value) {
+                subtree = subtree->left.load(std::memory_order_acquire);
+            } else if(subtree->value < value) {
+                subtree = subtree->right.load(std::memory_order_acquire);
+            } else {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool insert(const value_type& value) {
+        const std::lock_guard lock{writer_mutex};
+
+        link* const position = find_link(value);
+        if(position->load(std::memory_order_relaxed) != nullptr) {
+            return false;
+        }
+
+        position->store(new node(value), std::memory_order_release);
+        tree_size.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void erase(const value_type& value) {
+        const std::lock_guard lock{writer_mutex};
+
+        link* const position = find_link(value);
+        if(const node_ptr node_to_erase =
+               position->load(std::memory_order_relaxed);
+           node_to_erase != nullptr) {
+            extract_node(*position, node_to_erase);
+            tree_size.fetch_sub(1, std::memory_order_relaxed);
+
+            if(retired.size() >= retired_limit) {
+                reclaim_retired();
+            }
+        }
+    }
+
+private:
+    // Returns link pointing to node with equivalent value or empty link where
+    // such node belongs. Called only by the writer.
+    link* find_link(const value_type& value) {
+        link* position = &root;
+
+        while(node_ptr subtree = position->load(std::memory_order_relaxed)) {
+            if(value < subtree->value) {
+                position = &subtree->left;
+            } else if(subtree->value < value) {
+                position = &subtree->right;
+            } else {
+                break;
+            }
+        }
+
+        return position;
+    }
+
+    void extract_node(link& position, node_ptr node_to_erase) {
+        const node_ptr left =
+            node_to_erase->left.load(std::memory_order_relaxed);
+        const node_ptr right =
+            node_to_erase->right.load(std::memory_order_relaxed);
+
+        if(left == nullptr || right == nullptr) {
+            position.store(left != nullptr ? left : right,
+                           std::memory_order_release);
+        } else {
+            extract_double_node(position, node_to_erase);
+        }
+
+        retired.push_back(node_to_erase);
+    }
+
+    // Values are immutable for readers, so the node is replaced by a copy of
+    // its successor. The old successor may be unlinked only after a grace
+    // period: until then some readers may still be on their way to it.
+    void extract_double_node(link& position, node_ptr node_to_erase) {
+        link* min_position = &node_to_erase->right;
+        node_ptr min_node = min_position->load(std::memory_order_relaxed);
+        while(node_ptr left = min_node->left.load(std::memory_order_relaxed)) {
+            min_position = &min_node->left;
+            min_node = left;
+        }
+
+        const node_ptr replacement = new node(min_node->value);
+        replacement->left.store(
+            node_to_erase->left.load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+        replacement->right.store(
+            node_to_erase->right.load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+        position.store(replacement, std::memory_order_release);
+
+        if(min_position == &node_to_erase->right) {
+            min_position = &replacement->right;
+        }
+
+        domain.synchronize();
+        min_position->store(min_node->right.load(std::memory_order_relaxed),
+                            std::memory_order_release);
+        retired.push_back(min_node);
+    }
+
+    void reclaim_retired() {
+        if(!retired.empty()) {
+            domain.synchronize();
+            for(node_ptr retired_node : retired) {
+                delete retired_node;
+            }
+            retired.clear();
+        }
+    }
+};
+
+// Generator of test data, seeded by random_device unless seed_test_generator
+// is called first.
+inline std::mt19937& test_generator() {
+    static std::mt19937 generator{std::random_device{}()};
+    return generator;
+}
+
+// Makes test data reproducible.
+inline void seed_test_generator(std::mt19937::result_type seed) {
+    test_generator().seed(seed);
+}
+
+inline void shuffle_test_vector(std::vector<int>& test_vector) {
+    std::shuffle(test_vector.begin(), test_vector.end(), test_generator());
+}
+
+inline std::vector<int> generate_test_vector(std::size_t size) {
+    std::vector<int> test_vector(size);
+
+    std::iota(test_vector.begin(), test_vector.end(), 0);
+    shuffle_test_vector(test_vector);
+
+    return test_vector;
+}
@@ -0,0 +1,241 @@
+// Author: Jakub Mazurkiewicz
+// C++ standard: 17
+
+#include "stable-selection-sort.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    void addCard(Deck& deck, const Card& card) {
+        deck.pushFront(card);
+    }
+
+    void addCard(FlatDeck& deck, const Card& card) {
+        deck.pushBack(card);
+    }
+
+    void addCard(std::vector<Card>& deck, const Card& card) {
+        deck.push_back(card);
+    }
+
+    // Shoe of `cardCount` cards, which repeats cards of a standard deck.
+    template<typename Cards>
+    Cards generateShoe(std::size_t cardCount) {
+        const FlatDeck standardDeck = FlatDeck::generateStandardDeck();
+        const std::vector<Card> standardCards(standardDeck.begin(),
+                                              standardDeck.end());
+
+        Cards shoe;
+        for(std::size_t i = 0; i < cardCount; ++i) {
+            addCard(shoe, standardCards[i % standardCards.size()]);
+        }
+        return shoe;
+    }
+
+    template<typename Cards>
+    void shuffleCards(Cards& deck, std::mt19937& generator) {
+        deck.shuffle(generator);
+    }
+
+    void shuffleCards(std::vector<Card>& deck, std::mt19937& generator) {
+        std::shuffle(deck.begin(), deck.end(), generator);
+    }
+
+    // Sorting algorithms. Each one sorts cards with a comparator of cards.
+    struct SelectionSort {
+        template<typename Cards, typename Compare>
+        static void sort(Cards& deck, Compare compare) {
+            deck.stableSelectionSort(compare);
+        }
+    };
+
+    // Bucket sort compares no cards, so the comparator is unused.
+    struct BucketSort {
+        template<typename Cards, typename Compare>
+        static void sort(Cards& deck, Compare) {
+            deck.stableBucketSort();
+        }
+    };
+
+    struct MergeSort {
+        template<typename Cards, typename Compare>
+        static void sort(Cards& deck, Compare compare) {
+            deck.stableMergeSort(compare);
+        }
+    };
+
+    struct StdStableSort {
+        template<typename Compare>
+        static void sort(std::vector<Card>& deck, Compare compare) {
+            std::stable_sort(deck.begin(), deck.end(), compare);
+        }
+    };
+
+    class CountingLess {
+    private:
+        std::size_t* comparisonCount;
+
+    public:
+        explicit CountingLess(std::size_t& comparisonCount)
+            : comparisonCount{&comparisonCount} { }
+
+        bool operator()(const Card& lhs, const Card& rhs) const {
+            ++*comparisonCount;
+            return lhs < rhs;
+        }
+    };
+
+    // Successors of cards, identified by addresses. Deck relinks nodes and
+    // never moves cards, so changed successors are changed links. The first
+    // card is the successor of null.
+    using Successors = std::unordered_map<const Card*, const Card*>;
+
+    Successors findSuccessors(const Deck& deck) {
+        Successors successors;
+        const Card* previous = nullptr;
+        for(const Card& card : deck) {
+            successors[previous] = &card;
+            previous = &card;
+        }
+        successors[previous] = nullptr;
+        return successors;
+    }
+
+    std::size_t countRelinks(const Successors& oldSuccessors,
+                             const Deck& deck) {
+        std::size_t relinkCount = 0;
+        for(const auto& [card, successor] : findSuccessors(deck)) {
+            relinkCount += oldSuccessors.at(card) != successor;
+        }
+        return relinkCount;
+    }
+
+    void setCardCounters(benchmark::State& state, std::size_t cardCount) {
+        state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()) *
+                                static_cast<std::int64_t>(cardCount));
+        state.counters["time/card"] = benchmark::Counter(
+            static_cast<double>(cardCount),
+            benchmark::Counter::kIsIterationInvariantRate |
+                benchmark::Counter::kInvert);
+    }
+
+    void setCountCounter(benchmark::State& state, const char* name,
+                         std::size_t count, std::size_t cardCount) {
+        state.counters[name] =
+            static_cast<double>(count) / static_cast<double>(cardCount);
+    }
+
+    template<typename Cards>
+    void shuffleBenchmark(benchmark::State& state) {
+        const auto cardCount = static_cast<std::size_t>(state.range(0));
+        Cards deck = generateShoe<Cards>(cardCount);
+        std::mt19937 generator{
+            static_cast<std::mt19937::result_type>(cardCount)};
+
+        for(auto _ : state) {
+            shuffleCards(deck, generator);
+            benchmark::ClobberMemory();
+        }
+
+        setCardCounters(state, cardCount);
+
+        if constexpr(std::is_same_v<Cards, Deck>) {
+            const Successors oldSuccessors = findSuccessors(deck);
+            shuffleCards(deck, generator);
+            setCountCounter(state, "relinks/card",
+                            countRelinks(oldSuccessors, deck), cardCount);
+        }
+    }
+
+    // Every sort gets a freshly shuffled deck. Counts are taken in one more
+    // run after timing, so counting does not slow timed runs down.
+    template<typename Cards, typename Sort>
+    void sortBenchmark(benchmark::State& state) {
+        const auto cardCount = static_cast<std::size_t>(state.range(0));
+        Cards deck = generateShoe<Cards>(cardCount);
+        std::mt19937 generator{
+            static_cast<std::mt19937::result_type>(cardCount)};
+
+        for(auto _ : state) {
+            state.PauseTiming();
+            shuffleCards(deck, generator);
+            state.ResumeTiming();
+
+            Sort::sort(deck, std::less<>{});
+            benchmark::ClobberMemory();
+        }
+
+        setCardCounters(state, cardCount);
+
+        shuffleCards(deck, generator);
+        Successors oldSuccessors;
+        if constexpr(std::is_same_v<Cards, Deck>) {
+            oldSuccessors = findSuccessors(deck);
+        }
+
+        std::size_t comparisonCount = 0;
+        Sort::sort(deck, CountingLess{comparisonCount});
+        setCountCounter(state, "comparisons/card", comparisonCount, cardCount);
+
+        if constexpr(std::is_same_v<Cards, Deck>) {
+            setCountCounter(state, "relinks/card",
+                            countRelinks(oldSuccessors, deck), cardCount);
+        }
+    }
+
+    // Selection sort is quadratic, so its runs have to stay small.
+    constexpr std::int64_t minCardCount = 52;
+    constexpr std::int64_t maxCardCount = 1'000'000;
+    constexpr std::int64_t maxQuadraticCardCount = 10'000;
+
+    template<typename Cards>
+    void registerCards(const char* cardsName) {
+        const auto add = [&](const char* operation, auto function,
+                             std::int64_t lastCardCount) {
+            const std::string name = std::string{operation} + '/' + cardsName;
+            benchmark::RegisterBenchmark(name.c_str(), function)
+                ->RangeMultiplier(10)
+                ->Range(minCardCount, lastCardCount)
+                ->Unit(benchmark::kMicrosecond);
+        };
+
+        add("shuffle", shuffleBenchmark<Cards>, maxCardCount);
+
+        if constexpr(std::is_same_v<Cards, std::vector<Card>>) {
+            add("std::stable_sort", sortBenchmark<Cards, StdStableSort>,
+                maxCardCount);
+        } else {
+            add("stableSelectionSort", sortBenchmark<Cards, SelectionSort>,
+                maxQuadraticCardCount);
+            add("stableBucketSort", sortBenchmark<Cards, BucketSort>,
+                maxCardCount);
+            add("stableMergeSort", sortBenchmark<Cards, MergeSort>,
+                maxCardCount);
+        }
+    }
+} // namespace
+
+// Deck sizes range from 52 to 1e6 cards, so use --benchmark_filter to select
+// a subset, e.g. --benchmark_filter='Sort/Deck/'.
+int main(int argc, char* argv[]) {
+    registerCards<Deck>("Deck");
+    registerCards<FlatDeck>("FlatDeck");
+    registerCards<std::vector<Card>>("std::vector");
+
+    benchmark::Initialize(&argc, argv);
+    if(benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
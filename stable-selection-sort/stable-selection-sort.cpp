@@ -1,391 +1,342 @@
 // Author: Jakub Mazurkiewicz
 // C++ standard: 17
 
+#include "stable-selection-sort.hpp"
+
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <iostream>
-#include <iterator>
+#include <optional>
 #include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
-enum class CardRank : unsigned char {
-    TWO = '2',
-    THREE,
-    FOUR,
-    FIVE,
-    SIX,
-    SEVEN,
-    EIGHT,
-    NINE,
-    TEN,
-    JACK,
-    QUEEN,
-    KING,
-    ACE,
-};
-
-std::ostream& operator<<(std::ostream& stream, const CardRank& rank) {
-    switch(rank) {
-    case CardRank::TEN:
-        stream << "10";
-        break;
-
-    case CardRank::JACK:
-        stream << 'J';
-        break;
-
-    case CardRank::QUEEN:
-        stream << 'Q';
-        break;
-
-    case CardRank::KING:
-        stream << 'K';
-        break;
-
-    case CardRank::ACE:
-        stream << 'A';
-        break;
-
-    default:
-        stream << static_cast<unsigned char>(rank);
-    }
-
-    return stream;
-}
-
-enum CardSuite : unsigned char {
-    SPADE = 'S',
-    HEART = 'H',
-    DIAMOND = 'D',
-    CLUB = 'C',
-};
-
-std::ostream& operator<<(std::ostream& stream, const CardSuite& suite) {
-    return stream << static_cast<unsigned char>(suite);
-}
+// Positions of cards in a standard deck, indexed by card codes.
+using StandardDeckPositions = std::array<unsigned char, 52>;
 
-struct Card {
-    CardSuite suite;
-    CardRank rank;
-
-    friend std::ostream& operator<<(std::ostream& stream, const Card& card) {
-        return stream << '(' << card.rank << '|' << card.suite << ')';
-    }
-
-    bool operator==(const Card& other) const {
-        return rank == other.rank;
+template<typename CardDeck>
+void recordStandardDeckPositions(const CardDeck& deck,
+                                 StandardDeckPositions& positions) {
+    unsigned char position = 0;
+    for(const Card& card : deck) {
+        assert(position < positions.size());
+        positions[encodeCard(card)] = position++;
     }
+}
 
-    bool operator<(const Card& other) const {
-        return rank < other.rank;
-    }
-};
-
-class Deck {
-private:
-    struct Node {
-        Card card;
-        Node* next;
-
-        Node()
-            : Node(Card{}) { }
-
-        explicit Node(const Card& card, Node* next = nullptr)
-            : card{card}
-            , next{next} { }
-    };
+// Checks in one pass that the deck holds every card of a standard deck once
+// and that cards of equal ranks are in the order of recorded positions.
+template<typename CardDeck>
+bool isStandardDeckStablySorted(const CardDeck& deck,
+                                const StandardDeckPositions& positions) {
+    std::uint64_t seenCards = 0;
+    std::optional<Card> previousCard;
 
-    Node beforeHeadNode;
-    std::size_t deckSize;
+    for(const Card& card : deck) {
+        const CardCode code = encodeCard(card);
+        const std::uint64_t cardBit = std::uint64_t{1} << code;
 
-public:
-    Deck()
-        : beforeHeadNode{Card{}, nullptr}
-        , deckSize{0} { }
+        if((seenCards & cardBit) != 0) {
+            return false;
+        }
+        seenCards |= cardBit;
 
-    ~Deck() {
-        while(!empty()) {
-            popFront();
+        if(previousCard.has_value() && *previousCard == card &&
+           positions[encodeCard(*previousCard)] > positions[code]) {
+            return false;
         }
+        previousCard = card;
     }
 
-    Deck(Deck&& other)
-        : beforeHeadNode{std::exchange(other.beforeHeadNode, Node{})}
-        , deckSize{std::exchange(other.deckSize, 0)} { }
+    return seenCards == (std::uint64_t{1} << positions.size()) - 1;
+}
 
-    Deck& operator=(Deck&& other) {
-        if(&other != this) {
-            beforeHeadNode = std::exchange(other.beforeHeadNode, Node{});
-            deckSize = std::exchange(other.deckSize, 0);
+// Checks the order in one pass, since FlatDeck is only an input range.
+template<typename CardDeck, typename Compare>
+bool isDeckSorted(const CardDeck& deck, Compare compare) {
+    std::optional<Card> previousCard;
+    for(const Card& card : deck) {
+        if(previousCard.has_value() && compare(card, *previousCard)) {
+            return false;
         }
-
-        return *this;
+        previousCard = card;
     }
+    return true;
+}
 
-    std::size_t size() const {
-        return deckSize;
+template<typename CardDeck, typename Compare>
+bool isDeckTestPassed(std::ostream& report, const CardDeck& deck,
+                      const StandardDeckPositions& shuffledPositions,
+                      std::size_t testId, const char* deckName,
+                      const char* sortName, Compare compare) {
+    bool isPassed = true;
+
+    if(!isDeckSorted(deck, compare)) {
+        report << "Test " << testId << ":\t";
+        report << deckName << " was not sorted by " << sortName << ".\n";
+        isPassed = false;
     }
 
-    bool empty() const {
-        return size() == 0;
+    if(!isStandardDeckStablySorted(deck, shuffledPositions)) {
+        report << "Test " << testId << ":\t";
+        report << deckName << " was not stably sorted by " << sortName
+               << ".\n";
+        isPassed = false;
     }
 
-    class ConstIterator {
-    protected:
-        const Node* node;
-
-    public:
-        using value_type = Card;
-        using reference = const value_type&;
-        using pointer = const value_type*;
-        using difference_type = std::ptrdiff_t;
-        using iterator_category = std::forward_iterator_tag;
+    return isPassed;
+}
 
-        ConstIterator()
-            : node{nullptr} { }
-        explicit ConstIterator(const Node* node)
-            : node{node} { }
+// Runs tests with ids from [firstTestId, lastTestId) on a standard deck.
+template<typename CardDeck>
+bool runTestChunk(std::ostream& report, std::size_t firstTestId,
+                  std::size_t lastTestId, const char* deckName,
+                  std::mt19937& generator) {
+    CardDeck deck = CardDeck::generateStandardDeck();
+    assert(deck.size() == 52);
 
-        const Node* getNode() const {
-            return node;
-        }
+    StandardDeckPositions shuffledPositions;
+    bool isPassed = true;
 
-        ConstIterator& operator++() {
-            node = node->next;
-            return *this;
-        }
+    const std::pair<const char*, void (CardDeck::*)()> sorts[] = {
+        {"selection sort", &CardDeck::stableSelectionSort},
+        {"bucket sort", &CardDeck::stableBucketSort},
+        {"merge sort", &CardDeck::stableMergeSort},
+    };
+    const auto isGreater = [](const Card& lhs, const Card& rhs) {
+        return rhs < lhs;
+    };
 
-        ConstIterator operator++(int) {
-            ConstIterator copy = *this;
-            ++*this;
-            return copy;
-        }
+    for(std::size_t testId = firstTestId; testId < lastTestId; ++testId) {
+        for(const auto& [sortName, sort] : sorts) {
+            deck.shuffle(generator);
+            recordStandardDeckPositions(deck, shuffledPositions);
 
-        reference operator*() const {
-            return node->card;
-        }
+            (deck.*sort)();
 
-        pointer operator->() const {
-            return &(node->card);
+            if(!isDeckTestPassed(report, deck, shuffledPositions, testId,
+                                 deckName, sortName, std::less<>{})) {
+                isPassed = false;
+            }
         }
 
-        bool operator==(const ConstIterator& other) const {
-            return node == other.node;
-        }
+        deck.shuffle(generator);
+        recordStandardDeckPositions(deck, shuffledPositions);
 
-        bool operator!=(const ConstIterator& other) const {
-            return !(*this == other);
-        }
-    };
+        deck.stableMergeSort(isGreater);
 
-    class Iterator : public ConstIterator {
-    public:
-        using value_type = Card;
-        using reference = value_type&;
-        using pointer = value_type*;
-        using difference_type = std::ptrdiff_t;
-        using iterator_category = std::forward_iterator_tag;
-
-        Iterator()
-            : ConstIterator() { }
-        explicit Iterator(Node* node)
-            : ConstIterator(node) { }
-
-        Node* getNode() const {
-            return const_cast<Node*>(node);
+        if(!isDeckTestPassed(report, deck, shuffledPositions, testId,
+                             deckName, "descending merge sort", isGreater)) {
+            isPassed = false;
         }
+    }
 
-        reference operator*() const {
-            return const_cast<reference>(node->card);
-        }
+    return isPassed;
+}
 
-        pointer operator->() const {
-            return &const_cast<reference>(node->card);
+// Tests are split into chunks, each with a generator seeded from `seed` and
+// the chunk index, so results do not depend on the number of threads.
+// Threads take chunks in turn and write failures to per-chunk reports, which
+// are printed in order after all threads finish.
+template<typename CardDeck>
+int genericDeckTest(std::size_t testCount, const char* deckName,
+                    std::uint32_t seed, unsigned threadCount) {
+    constexpr std::size_t chunkSize = 16'384;
+    const std::size_t chunkCount = (testCount + chunkSize - 1) / chunkSize;
+
+    std::vector<std::string> reports(chunkCount);
+    std::vector<char> isChunkPassed(chunkCount);
+    std::atomic<std::size_t> nextChunk{0};
+
+    const auto runChunks = [&] {
+        std::ostringstream report;
+
+        for(std::size_t chunk = nextChunk++; chunk < chunkCount;
+            chunk = nextChunk++) {
+            std::seed_seq chunkSeed{
+                seed, static_cast<std::uint32_t>(chunk),
+                static_cast<std::uint32_t>(
+                    static_cast<std::uint64_t>(chunk) >> 32)};
+            std::mt19937 generator{chunkSeed};
+
+            const std::size_t firstTestId = chunk * chunkSize + 1;
+            const std::size_t lastTestId =
+                std::min(firstTestId + chunkSize, testCount + 1);
+
+            report.str({});
+            isChunkPassed[chunk] = runTestChunk<CardDeck>(
+                report, firstTestId, lastTestId, deckName, generator);
+            reports[chunk] = report.str();
         }
     };
 
-    Iterator beforeBegin() {
-        return Iterator{&beforeHeadNode};
-    }
-
-    Iterator begin() {
-        return std::next(beforeBegin());
-    }
+    threadCount = static_cast<unsigned>(
+        std::clamp<std::size_t>(chunkCount, 1, std::max(threadCount, 1u)));
 
-    Iterator end() {
-        return Iterator{nullptr};
+    std::vector<std::thread> threads;
+    for(unsigned i = 1; i < threadCount; ++i) {
+        threads.emplace_back(runChunks);
     }
-
-    ConstIterator beforeBegin() const {
-        return ConstIterator{&beforeHeadNode};
+    runChunks();
+    for(std::thread& thread : threads) {
+        thread.join();
     }
 
-    ConstIterator begin() const {
-        return std::next(beforeBegin());
+    for(const std::string& report : reports) {
+        std::cout << report;
     }
 
-    ConstIterator end() const {
-        return ConstIterator{nullptr};
-    }
+    const bool isPassed =
+        std::all_of(isChunkPassed.begin(), isChunkPassed.end(),
+                    [](char isPassed) { return isPassed != 0; });
+    return isPassed ? 0 : 1;
+}
 
-    void pushFront(const Card& card) {
-        insertAfter(beforeBegin(), card);
+bool haveSameCards(const Deck& deck, const std::vector<CardCode>& codes,
+                   std::size_t firstCode) {
+    std::size_t code = firstCode;
+    for(const Card& card : deck) {
+        if(code == codes.size() || encodeCard(card) != codes[code++]) {
+            return false;
+        }
     }
 
-    void popFront() {
-        eraseAfter(beforeBegin());
-    }
+    return code - firstCode == 52;
+}
 
-    void insertAfter(Iterator it, const Card& card) {
-        attachAfter(it.getNode(), new Node{card});
-        ++deckSize;
-    }
+// Writes shuffled decks into shared buffers and parses them back.
+int serializationTest(std::uint32_t seed) {
+    constexpr std::size_t deckCount = 256;
 
-    void eraseAfter(Iterator it) {
-        delete extractAfter(it.getNode());
-        --deckSize;
-    }
+    std::mt19937 generator{seed};
+    Deck deck = Deck::generateStandardDeck();
 
-private:
-    void attachAfter(Node* node, Node* nodeToAttach) {
-        assert(node != nullptr);
+    std::vector<char> text(deckCount * deckTextCapacity(deck.size()));
+    std::vector<char> codes(deckCount * deck.size());
+    char* textEnd = text.data();
+    char* codesEnd = codes.data();
 
-        nodeToAttach->next = node->next;
-        node->next = nodeToAttach;
-    }
+    std::ostringstream streamedText;
+    std::vector<CardCode> shuffledCodes;
 
-    [[nodiscard]] Node* extractAfter(Node* node) {
-        assert(node != nullptr);
-        assert(node->next != nullptr);
+    for(std::size_t i = 0; i < deckCount; ++i) {
+        deck.shuffle(generator);
+        streamedText << deck;
+        for(const Card& card : deck) {
+            shuffledCodes.push_back(encodeCard(card));
+        }
 
-        Node* const nodeToExtract = node->next;
-        node->next = nodeToExtract->next;
-        return nodeToExtract;
+        textEnd = writeDeckText(deck, textEnd, text.data() + text.size());
+        codesEnd = writeDeckCodes(deck, codesEnd, codes.data() + codes.size());
     }
 
-public:
-    template<typename Generator>
-    void shuffle(Generator& generator) {
-        using DifferenceType = Iterator::difference_type;
-        using Distribution = std::uniform_int_distribution<DifferenceType>;
-        using ParamType = Distribution::param_type;
-
-        Distribution distr;
-        DifferenceType minOffset = 0;
-
-        for(Iterator it = begin(); it != end(); ++it) {
-            const ParamType param{minOffset++,
-                                  static_cast<DifferenceType>(size() - 1)};
-            const DifferenceType offset = distr(generator, param);
-            std::iter_swap(it, std::next(begin(), offset));
-        }
-    }
+    int testStatus = 0;
 
-    void stableSelectionSort() {
-        Iterator inserter = beforeBegin();
+    if(std::string(text.data(), textEnd) != streamedText.str()) {
+        std::cout << "Serialization:\tDeck text differs from operator<<.\n";
+        testStatus = 1;
+    }
 
-        while(std::next(inserter) != end()) {
-            Iterator beforeMin = findBeforeMin(inserter);
+    const char* parsedText = text.data();
+    const char* parsedCodes = codes.data();
 
-            Node* const extracted = extractAfter(beforeMin.getNode());
-            attachAfter(inserter.getNode(), extracted);
-            ++inserter;
+    for(std::size_t i = 0; i < deckCount; ++i) {
+        parsedText = parseDeckText(parsedText, textEnd, deck);
+        if(!haveSameCards(deck, shuffledCodes, i * 52)) {
+            std::cout << "Serialization:\tDeck " << i + 1
+                      << " was not parsed from text.\n";
+            testStatus = 1;
         }
-    }
 
-private:
-    Iterator findBeforeMin(Iterator beforeStart) {
-        Iterator beforeMin = beforeStart;
-        while(++beforeStart != end() && std::next(beforeStart) != end()) {
-            if(*std::next(beforeStart) < *std::next(beforeMin)) {
-                beforeMin = beforeStart;
-            }
+        parsedCodes = parseDeckCodes(parsedCodes, codesEnd, 52, deck);
+        if(!haveSameCards(deck, shuffledCodes, i * 52)) {
+            std::cout << "Serialization:\tDeck " << i + 1
+                      << " was not parsed from codes.\n";
+            testStatus = 1;
         }
-
-        assert(beforeMin != end());
-        assert(std::next(beforeMin) != end());
-
-        return beforeMin;
     }
 
-public:
-    friend std::ostream& operator<<(std::ostream& stream, const Deck& deck) {
-        stream << '[';
-
-        if(!deck.empty()) {
-            ConstIterator it = deck.begin();
-            stream << *it;
-
-            while(++it != deck.end()) {
-                stream << ", " << *it;
-            }
+    for(const std::string malformedText : {"[(1|S)]", "[(2|X)]", "[(2|S)"}) {
+        try {
+            parseDeckText(malformedText.data(),
+                          malformedText.data() + malformedText.size(), deck);
+            std::cout << "Serialization:\tMalformed text " << malformedText
+                      << " was parsed.\n";
+            testStatus = 1;
+        } catch(std::invalid_argument&) {
         }
-
-        return stream << ']';
     }
 
-    static Deck generateStandardDeck() {
-        Deck deck;
+    return testStatus;
+}
 
-        for(CardRank rank = CardRank::ACE; rank >= CardRank::TWO;) {
-            for(CardSuite suite : {CardSuite::SPADE, CardSuite::HEART,
-                                   CardSuite::CLUB, CardSuite::DIAMOND}) {
-                deck.pushFront(Card{suite, rank});
-            }
-            rank = static_cast<CardRank>(static_cast<unsigned char>(rank) - 1);
-        }
+int genericTest(std::size_t testCount, std::uint32_t seed,
+                unsigned threadCount) {
+    const int deckStatus =
+        genericDeckTest<Deck>(testCount, "Deck", seed, threadCount);
+    const int flatDeckStatus =
+        genericDeckTest<FlatDeck>(testCount, "FlatDeck", seed, threadCount);
+    const int serializationStatus = serializationTest(seed);
 
-        return deck;
+    if(deckStatus != 0 || flatDeckStatus != 0 || serializationStatus != 0) {
+        return 1;
     }
-};
+    return 0;
+}
 
-bool isStandardDeckStablySorted(const Deck& deck,
-                                const std::vector<Card>& shuffledCollection) {
-    for(auto it = deck.begin(); it != deck.end();) {
-        auto jt = shuffledCollection.begin();
-        for(int i = 0; i < 4; ++i) {
-            jt = std::find(jt, shuffledCollection.end(), *it);
+int batchTest(std::size_t deckCount, std::uint32_t seed) {
+    using Clock = std::chrono::steady_clock;
 
-            if(jt == shuffledCollection.end()) {
-                return false;
-            }
+    DeckBatch batch{deckCount, seed};
 
-            ++it;
-        }
-    }
+    const Clock::time_point shuffleStart = Clock::now();
+    batch.shuffle();
+    const Clock::duration shuffleTime = Clock::now() - shuffleStart;
 
-    return true;
-}
+    const DeckBatch shuffledBatch = batch;
 
-int genericTest(std::size_t testCount) {
-    Deck deck = Deck::generateStandardDeck();
-    assert(deck.size() == 52);
+    const Clock::time_point sortStart = Clock::now();
+    batch.stableBucketSort();
+    const Clock::duration sortTime = Clock::now() - sortStart;
 
     int testStatus = 0;
+    StandardDeckPositions shuffledPositions;
 
-    std::mt19937 generator{std::random_device{}()};
-
-    for(std::size_t testId = 1; testId <= testCount; ++testId) {
-        deck.shuffle(generator);
-        std::vector shuffledCollection(deck.begin(), deck.end());
-
-        deck.stableSelectionSort();
+    for(std::size_t deckIndex = 0; deckIndex < batch.size(); ++deckIndex) {
+        const std::vector<Card> deck = batch.cards(deckIndex);
+        recordStandardDeckPositions(shuffledBatch.cards(deckIndex),
+                                    shuffledPositions);
 
         if(!std::is_sorted(deck.begin(), deck.end())) {
-            std::cout << "Test " << testId << ":\t";
-            std::cout << "Deck was not sorted.\n";
+            std::cout << "Test " << deckIndex + 1 << ":\t";
+            std::cout << "Batched deck was not sorted.\n";
             testStatus = 1;
         }
 
-        if(!isStandardDeckStablySorted(deck, shuffledCollection)) {
-            std::cout << "Test " << testId << ":\t";
-            std::cout << "Deck was not stably sorted.\n";
+        if(!isStandardDeckStablySorted(deck, shuffledPositions)) {
+            std::cout << "Test " << deckIndex + 1 << ":\t";
+            std::cout << "Batched deck was not stably sorted.\n";
             testStatus = 1;
         }
     }
 
+    const std::chrono::duration<double> time = shuffleTime + sortTime;
+    std::cout << "Shuffled and sorted " << deckCount << " decks in "
+              << time.count() << " s";
+    if(time.count() > 0) {
+        std::cout << " (" << deckCount / time.count() << " decks/s)";
+    }
+    std::cout << ".\n";
+
     return testStatus;
 }
 
@@ -403,7 +354,8 @@ int interactiveTest() {
     deck.shuffle(generator);
     std::cout << "Shuffled deck:\n";
     std::cout << deck << '\n';
-    std::vector shuffledCollection(deck.begin(), deck.end());
+    StandardDeckPositions shuffledPositions;
+    recordStandardDeckPositions(deck, shuffledPositions);
 
     deck.stableSelectionSort();
     std::cout << "Stably sorted deck:\n";
@@ -416,7 +368,7 @@ int interactiveTest() {
     }
 
     const bool isDeckStablySorted =
-        isStandardDeckStablySorted(deck, shuffledCollection);
+        isStandardDeckStablySorted(deck, shuffledPositions);
     std::cout << "Is deck stably sorted: " << isDeckStablySorted << ".\n";
     if(!isDeckStablySorted) {
         testStatus = 1;
@@ -425,17 +377,55 @@ int interactiveTest() {
     return testStatus;
 }
 
+// Program arguments are the number of tests, `--batch` testing DeckBatch
+// instead of decks, `--seed=<number>` making tests reproducible and
+// `--threads=<number>` (hardware concurrency by default). Without the
+// number of tests one deck is sorted interactively.
 int main(int argc, char* argv[]) {
-    int status = 0;
+    std::optional<std::size_t> testCount;
+    std::optional<std::uint32_t> seed;
+    unsigned threadCount = std::thread::hardware_concurrency();
+    bool isBatchTest = false;
 
-    if(argc >= 2) {
+    for(int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
         try {
-            status = genericTest(std::stoull(argv[1]));
+            if(argument == "--batch") {
+                isBatchTest = true;
+            } else if(argument.rfind("--seed=", 0) == 0) {
+                seed = static_cast<std::uint32_t>(
+                    std::stoul(argument.substr(7)));
+            } else if(argument.rfind("--threads=", 0) == 0) {
+                threadCount =
+                    static_cast<unsigned>(std::stoul(argument.substr(10)));
+            } else {
+                testCount = std::stoull(argument);
+            }
         } catch(std::exception& e) {
-            std::cerr << "Fatal error: " << e.what() << '\n';
+            std::cerr << "Invalid program argument " << argument << ": "
+                      << e.what() << ".\n";
+            std::cerr << "The argument is ignored.\n";
+        }
+    }
+
+    if(!testCount.has_value()) {
+        return interactiveTest();
+    }
+
+    const std::uint32_t seedValue = seed.value_or(std::random_device{}());
+    std::cout << "Tests are generated with seed " << seedValue << ".\n";
+
+    int status = 0;
+
+    try {
+        if(isBatchTest) {
+            status = batchTest(*testCount, seedValue);
+        } else {
+            status = genericTest(*testCount, seedValue, threadCount);
         }
-    } else {
-        status = interactiveTest();
+    } catch(std::exception& e) {
+        std::cerr << "Fatal error: " << e.what() << '\n';
+        status = 1;
     }
 
     return status;
@@ -0,0 +1,1082 @@
+// Author: Jakub Mazurkiewicz
+// C++ standard: 17
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class CardRank : unsigned char {
+    TWO = '2',
+    THREE,
+    FOUR,
+    FIVE,
+    SIX,
+    SEVEN,
+    EIGHT,
+    NINE,
+    TEN,
+    JACK,
+    QUEEN,
+    KING,
+    ACE,
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const CardRank& rank) {
+    switch(rank) {
+    case CardRank::TEN:
+        stream << "10";
+        break;
+
+    case CardRank::JACK:
+        stream << 'J';
+        break;
+
+    case CardRank::QUEEN:
+        stream << 'Q';
+        break;
+
+    case CardRank::KING:
+        stream << 'K';
+        break;
+
+    case CardRank::ACE:
+        stream << 'A';
+        break;
+
+    default:
+        stream << static_cast<unsigned char>(rank);
+    }
+
+    return stream;
+}
+
+enum CardSuite : unsigned char {
+    SPADE = 'S',
+    HEART = 'H',
+    DIAMOND = 'D',
+    CLUB = 'C',
+};
+
+inline std::ostream& operator<<(std::ostream& stream, const CardSuite& suite) {
+    return stream << static_cast<unsigned char>(suite);
+}
+
+struct Card {
+    CardSuite suite;
+    CardRank rank;
+
+    friend std::ostream& operator<<(std::ostream& stream, const Card& card) {
+        return stream << '(' << card.rank << '|' << card.suite << ')';
+    }
+
+    bool operator==(const Card& other) const {
+        return rank == other.rank;
+    }
+
+    bool operator<(const Card& other) const {
+        return rank < other.rank;
+    }
+};
+
+inline constexpr std::size_t rankCount =
+    static_cast<std::size_t>(CardRank::ACE) -
+    static_cast<std::size_t>(CardRank::TWO) + 1;
+
+inline std::size_t rankIndex(CardRank rank) {
+    return static_cast<std::size_t>(rank) -
+           static_cast<std::size_t>(CardRank::TWO);
+}
+
+inline std::size_t suiteIndex(CardSuite suite) {
+    switch(suite) {
+    case CardSuite::SPADE:
+        return 0;
+
+    case CardSuite::HEART:
+        return 1;
+
+    case CardSuite::DIAMOND:
+        return 2;
+
+    default:
+        return 3;
+    }
+}
+
+// Card packed into 6 bits as rank index * 4 + suite index.
+using CardCode = unsigned char;
+
+inline CardCode encodeCard(const Card& card) {
+    return static_cast<CardCode>(rankIndex(card.rank) * 4 +
+                                 suiteIndex(card.suite));
+}
+
+inline Card decodeCard(CardCode code) {
+    constexpr CardSuite suites[] = {CardSuite::SPADE, CardSuite::HEART,
+                                    CardSuite::DIAMOND, CardSuite::CLUB};
+    const auto rank = static_cast<unsigned char>(CardRank::TWO) + code / 4;
+    return Card{suites[code % 4], static_cast<CardRank>(rank)};
+}
+
+template<typename Iterator>
+std::ostream& printCards(std::ostream& stream, Iterator first, Iterator last) {
+    stream << '[';
+
+    if(first != last) {
+        stream << *first;
+
+        while(++first != last) {
+            stream << ", " << *first;
+        }
+    }
+
+    return stream << ']';
+}
+
+class Deck {
+private:
+    struct Node {
+        Card card;
+        Node* next;
+
+        Node()
+            : Node(Card{}) { }
+
+        explicit Node(const Card& card, Node* next = nullptr)
+            : card{card}
+            , next{next} { }
+    };
+
+    // Allocates nodes from slabs whose capacity doubles, starting with one
+    // standard deck. Slabs are heap blocks, so moving a pool keeps nodes in
+    // place. Released nodes are reused before a new slab is allocated.
+    class NodePool {
+    public:
+        NodePool() = default;
+
+        NodePool(NodePool&& other)
+            : slabs{std::move(other.slabs)}
+            , freeNodes{std::exchange(other.freeNodes, nullptr)}
+            , lastSlabUsage{std::exchange(other.lastSlabUsage, 0)} { }
+
+        NodePool& operator=(NodePool&& other) {
+            if(&other != this) {
+                slabs = std::move(other.slabs);
+                other.slabs.clear();
+                freeNodes = std::exchange(other.freeNodes, nullptr);
+                lastSlabUsage = std::exchange(other.lastSlabUsage, 0);
+            }
+
+            return *this;
+        }
+
+        [[nodiscard]] Node* allocate(const Card& card) {
+            Node* node = freeNodes;
+
+            if(node != nullptr) {
+                freeNodes = node->next;
+            } else {
+                if(slabs.empty() ||
+                   lastSlabUsage == slabCapacity(slabs.size() - 1)) {
+                    slabs.push_back(
+                        std::make_unique<Node[]>(slabCapacity(slabs.size())));
+                    lastSlabUsage = 0;
+                }
+
+                node = &slabs.back()[lastSlabUsage++];
+            }
+
+            *node = Node{card};
+            return node;
+        }
+
+        void deallocate(Node* node) {
+            node->next = freeNodes;
+            freeNodes = node;
+        }
+
+    private:
+        static constexpr std::size_t firstSlabCapacity = 52;
+
+        static std::size_t slabCapacity(std::size_t slabIndex) {
+            return firstSlabCapacity << slabIndex;
+        }
+
+        std::vector<std::unique_ptr<Node[]>> slabs;
+        Node* freeNodes = nullptr;
+        std::size_t lastSlabUsage = 0;
+    };
+
+    Node beforeHeadNode;
+    std::size_t deckSize;
+    NodePool nodePool;
+    // Scratch space of shuffle(). It is not moved with the nodes.
+    std::vector<Node*> shuffleBuffer;
+
+public:
+    Deck()
+        : beforeHeadNode{Card{}, nullptr}
+        , deckSize{0} { }
+
+    Deck(Deck&& other)
+        : beforeHeadNode{std::exchange(other.beforeHeadNode, Node{})}
+        , deckSize{std::exchange(other.deckSize, 0)}
+        , nodePool{std::move(other.nodePool)} { }
+
+    Deck& operator=(Deck&& other) {
+        if(&other != this) {
+            beforeHeadNode = std::exchange(other.beforeHeadNode, Node{});
+            deckSize = std::exchange(other.deckSize, 0);
+            nodePool = std::move(other.nodePool);
+        }
+
+        return *this;
+    }
+
+    std::size_t size() const {
+        return deckSize;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    class ConstIterator {
+    protected:
+        const Node* node;
+
+    public:
+        using value_type = Card;
+        using reference = const value_type&;
+        using pointer = const value_type*;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        ConstIterator()
+            : node{nullptr} { }
+        explicit ConstIterator(const Node* node)
+            : node{node} { }
+
+        const Node* getNode() const {
+            return node;
+        }
+
+        ConstIterator& operator++() {
+            node = node->next;
+            return *this;
+        }
+
+        ConstIterator operator++(int) {
+            ConstIterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        reference operator*() const {
+            return node->card;
+        }
+
+        pointer operator->() const {
+            return &(node->card);
+        }
+
+        bool operator==(const ConstIterator& other) const {
+            return node == other.node;
+        }
+
+        bool operator!=(const ConstIterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    class Iterator : public ConstIterator {
+    public:
+        using value_type = Card;
+        using reference = value_type&;
+        using pointer = value_type*;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        Iterator()
+            : ConstIterator() { }
+        explicit Iterator(Node* node)
+            : ConstIterator(node) { }
+
+        Node* getNode() const {
+            return const_cast<Node*>(node);
+        }
+
+        reference operator*() const {
+            return const_cast<reference>(node->card);
+        }
+
+        pointer operator->() const {
+            return &const_cast<reference>(node->card);
+        }
+    };
+
+    Iterator beforeBegin() {
+        return Iterator{&beforeHeadNode};
+    }
+
+    Iterator begin() {
+        return std::next(beforeBegin());
+    }
+
+    Iterator end() {
+        return Iterator{nullptr};
+    }
+
+    ConstIterator beforeBegin() const {
+        return ConstIterator{&beforeHeadNode};
+    }
+
+    ConstIterator begin() const {
+        return std::next(beforeBegin());
+    }
+
+    ConstIterator end() const {
+        return ConstIterator{nullptr};
+    }
+
+    void pushFront(const Card& card) {
+        insertAfter(beforeBegin(), card);
+    }
+
+    void popFront() {
+        eraseAfter(beforeBegin());
+    }
+
+    void insertAfter(Iterator it, const Card& card) {
+        attachAfter(it.getNode(), nodePool.allocate(card));
+        ++deckSize;
+    }
+
+    void eraseAfter(Iterator it) {
+        nodePool.deallocate(extractAfter(it.getNode()));
+        --deckSize;
+    }
+
+private:
+    void attachAfter(Node* node, Node* nodeToAttach) {
+        assert(node != nullptr);
+
+        nodeToAttach->next = node->next;
+        node->next = nodeToAttach;
+    }
+
+    [[nodiscard]] Node* extractAfter(Node* node) {
+        assert(node != nullptr);
+        assert(node->next != nullptr);
+
+        Node* const nodeToExtract = node->next;
+        node->next = nodeToExtract->next;
+        return nodeToExtract;
+    }
+
+public:
+    // Fisher-Yates shuffle of node pointers gathered into a scratch buffer,
+    // which is reused between calls. Nodes are relinked in shuffled order.
+    template<typename Generator>
+    void shuffle(Generator& generator) {
+        using Distribution = std::uniform_int_distribution<std::size_t>;
+        using ParamType = Distribution::param_type;
+
+        shuffleBuffer.clear();
+        for(Node* node = beforeHeadNode.next; node != nullptr;
+            node = node->next) {
+            shuffleBuffer.push_back(node);
+        }
+
+        Distribution distr;
+        for(std::size_t i = 0; i + 1 < shuffleBuffer.size(); ++i) {
+            const ParamType param{i, shuffleBuffer.size() - 1};
+            std::swap(shuffleBuffer[i], shuffleBuffer[distr(generator, param)]);
+        }
+
+        Node* tail = &beforeHeadNode;
+        for(Node* node : shuffleBuffer) {
+            tail->next = node;
+            tail = node;
+        }
+        tail->next = nullptr;
+    }
+
+    template<typename Compare>
+    void stableSelectionSort(Compare compare) {
+        Iterator inserter = beforeBegin();
+
+        while(std::next(inserter) != end()) {
+            Iterator beforeMin = findBeforeMin(inserter, compare);
+
+            Node* const extracted = extractAfter(beforeMin.getNode());
+            attachAfter(inserter.getNode(), extracted);
+            ++inserter;
+        }
+    }
+
+    void stableSelectionSort() {
+        stableSelectionSort(std::less<>{});
+    }
+
+    // Distributes nodes into sublists of equal ranks in one pass and links
+    // the sublists in order of ranks. Nodes are relinked, not copied.
+    void stableBucketSort() {
+        Node* bucketHeads[rankCount] = {};
+        Node** bucketTails[rankCount];
+        for(std::size_t bucket = 0; bucket < rankCount; ++bucket) {
+            bucketTails[bucket] = &bucketHeads[bucket];
+        }
+
+        for(Node* node = beforeHeadNode.next; node != nullptr;
+            node = node->next) {
+            const std::size_t bucket = rankIndex(node->card.rank);
+            *bucketTails[bucket] = node;
+            bucketTails[bucket] = &node->next;
+        }
+
+        Node** tail = &beforeHeadNode.next;
+        for(std::size_t bucket = 0; bucket < rankCount; ++bucket) {
+            if(bucketHeads[bucket] != nullptr) {
+                *tail = bucketHeads[bucket];
+                tail = bucketTails[bucket];
+            }
+        }
+        *tail = nullptr;
+    }
+
+    // Bottom-up merge sort which merges runs of doubling length by relinking
+    // nodes. Equal cards are taken from the left run first.
+    template<typename Compare>
+    void stableMergeSort(Compare compare) {
+        for(std::size_t runLength = 1; runLength < size(); runLength *= 2) {
+            Node* tail = &beforeHeadNode;
+            Node* rest = beforeHeadNode.next;
+
+            while(rest != nullptr) {
+                Node* const left = rest;
+                Node* const right = splitAfter(left, runLength);
+                rest = splitAfter(right, runLength);
+                tail = mergeAfter(tail, left, right, compare);
+            }
+        }
+    }
+
+    void stableMergeSort() {
+        stableMergeSort(std::less<>{});
+    }
+
+private:
+    // Cuts the list after `count` nodes and returns the rest of it.
+    static Node* splitAfter(Node* node, std::size_t count) {
+        for(; node != nullptr && count > 1; --count) {
+            node = node->next;
+        }
+
+        if(node == nullptr) {
+            return nullptr;
+        }
+
+        return std::exchange(node->next, nullptr);
+    }
+
+    // Links merged lists after `tail` and returns the last merged node.
+    template<typename Compare>
+    static Node* mergeAfter(Node* tail, Node* left, Node* right,
+                            Compare& compare) {
+        while(left != nullptr && right != nullptr) {
+            Node*& taken = compare(right->card, left->card) ? right : left;
+            tail->next = taken;
+            tail = taken;
+            taken = taken->next;
+        }
+
+        tail->next = left != nullptr ? left : right;
+        while(tail->next != nullptr) {
+            tail = tail->next;
+        }
+
+        return tail;
+    }
+
+    template<typename Compare>
+    Iterator findBeforeMin(Iterator beforeStart, Compare& compare) {
+        Iterator beforeMin = beforeStart;
+        while(++beforeStart != end() && std::next(beforeStart) != end()) {
+            if(compare(*std::next(beforeStart), *std::next(beforeMin))) {
+                beforeMin = beforeStart;
+            }
+        }
+
+        assert(beforeMin != end());
+        assert(std::next(beforeMin) != end());
+
+        return beforeMin;
+    }
+
+public:
+    friend std::ostream& operator<<(std::ostream& stream, const Deck& deck) {
+        return printCards(stream, deck.begin(), deck.end());
+    }
+
+    static Deck generateStandardDeck() {
+        Deck deck;
+        Iterator last = deck.beforeBegin();
+
+        // Cards are appended, so they follow each other in the node pool.
+        for(CardRank rank = CardRank::TWO; rank <= CardRank::ACE;) {
+            for(CardSuite suite : {CardSuite::DIAMOND, CardSuite::CLUB,
+                                   CardSuite::HEART, CardSuite::SPADE}) {
+                deck.insertAfter(last, Card{suite, rank});
+                ++last;
+            }
+            rank = static_cast<CardRank>(static_cast<unsigned char>(rank) + 1);
+        }
+
+        return deck;
+    }
+};
+
+// Deck stored as a contiguous array of card codes. It has the same sorting
+// and shuffling interface as Deck, and its iterators yield decoded cards.
+class FlatDeck {
+private:
+    std::vector<CardCode> codes;
+    // Scratch space of sorts. It is reused between calls.
+    std::vector<CardCode> sortBuffer;
+
+public:
+    std::size_t size() const {
+        return codes.size();
+    }
+
+    bool empty() const {
+        return codes.empty();
+    }
+
+    // Cards are decoded on the fly, so iterators return them by value and
+    // only make an input range.
+    class ConstIterator {
+    private:
+        const CardCode* code;
+
+    public:
+        using value_type = Card;
+        using reference = value_type;
+        using pointer = void;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::input_iterator_tag;
+
+        ConstIterator()
+            : code{nullptr} { }
+        explicit ConstIterator(const CardCode* code)
+            : code{code} { }
+
+        ConstIterator& operator++() {
+            ++code;
+            return *this;
+        }
+
+        ConstIterator operator++(int) {
+            ConstIterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        reference operator*() const {
+            return decodeCard(*code);
+        }
+
+        bool operator==(const ConstIterator& other) const {
+            return code == other.code;
+        }
+
+        bool operator!=(const ConstIterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    ConstIterator begin() const {
+        return ConstIterator{codes.data()};
+    }
+
+    ConstIterator end() const {
+        return ConstIterator{codes.data() + codes.size()};
+    }
+
+    void pushFront(const Card& card) {
+        codes.insert(codes.begin(), encodeCard(card));
+    }
+
+    void popFront() {
+        codes.erase(codes.begin());
+    }
+
+    void pushBack(const Card& card) {
+        codes.push_back(encodeCard(card));
+    }
+
+    void popBack() {
+        codes.pop_back();
+    }
+
+    template<typename Generator>
+    void shuffle(Generator& generator) {
+        using Distribution = std::uniform_int_distribution<std::size_t>;
+        using ParamType = Distribution::param_type;
+
+        Distribution distr;
+        for(std::size_t i = 0; i + 1 < codes.size(); ++i) {
+            const ParamType param{i, codes.size() - 1};
+            std::swap(codes[i], codes[distr(generator, param)]);
+        }
+    }
+
+    // Rotates the first minimal card of the unsorted part to its front.
+    template<typename Compare>
+    void stableSelectionSort(Compare compare) {
+        const auto compareCodes = decodingCompare(compare);
+
+        for(auto it = codes.begin(); it != codes.end(); ++it) {
+            const auto min = std::min_element(it, codes.end(), compareCodes);
+            std::rotate(it, min, std::next(min));
+        }
+    }
+
+    void stableSelectionSort() {
+        stableSelectionSort(std::less<>{});
+    }
+
+    // Counting sort of ranks which scatters codes into the scratch buffer.
+    void stableBucketSort() {
+        std::size_t rankOffsets[rankCount + 1] = {};
+        for(CardCode code : codes) {
+            ++rankOffsets[code / 4 + 1];
+        }
+        std::partial_sum(std::begin(rankOffsets), std::end(rankOffsets),
+                         std::begin(rankOffsets));
+
+        sortBuffer.resize(codes.size());
+        for(CardCode code : codes) {
+            sortBuffer[rankOffsets[code / 4]++] = code;
+        }
+        codes.swap(sortBuffer);
+    }
+
+    // Bottom-up merge sort which merges runs of doubling length between the
+    // array and the scratch buffer.
+    template<typename Compare>
+    void stableMergeSort(Compare compare) {
+        const auto compareCodes = decodingCompare(compare);
+        const std::size_t count = codes.size();
+
+        sortBuffer.resize(count);
+        for(std::size_t runLength = 1; runLength < count; runLength *= 2) {
+            for(std::size_t first = 0; first < count; first += 2 * runLength) {
+                const std::size_t middle = std::min(first + runLength, count);
+                const std::size_t last = std::min(middle + runLength, count);
+                std::merge(codes.begin() + first, codes.begin() + middle,
+                           codes.begin() + middle, codes.begin() + last,
+                           sortBuffer.begin() + first, compareCodes);
+            }
+            codes.swap(sortBuffer);
+        }
+    }
+
+    void stableMergeSort() {
+        stableMergeSort(std::less<>{});
+    }
+
+private:
+    // Adapts a comparator of cards to codes.
+    template<typename Compare>
+    static auto decodingCompare(Compare& compare) {
+        return [&compare](CardCode lhs, CardCode rhs) {
+            return compare(decodeCard(lhs), decodeCard(rhs));
+        };
+    }
+
+public:
+    friend std::ostream& operator<<(std::ostream& stream,
+                                    const FlatDeck& deck) {
+        return printCards(stream, deck.begin(), deck.end());
+    }
+
+    static FlatDeck generateStandardDeck() {
+        FlatDeck deck;
+        deck.codes.reserve(52);
+
+        for(CardRank rank = CardRank::TWO; rank <= CardRank::ACE;) {
+            for(CardSuite suite : {CardSuite::DIAMOND, CardSuite::CLUB,
+                                   CardSuite::HEART, CardSuite::SPADE}) {
+                deck.pushBack(Card{suite, rank});
+            }
+            rank = static_cast<CardRank>(static_cast<unsigned char>(rank) + 1);
+        }
+
+        return deck;
+    }
+};
+
+// Many standard decks stored as structure of arrays. Decks are grouped in
+// tiles of `tileWidth` decks, and codes of one position in a tile are
+// contiguous, so inner loops run over decks with no dependencies between
+// iterations and can be vectorized by the compiler. A tile fits in L1 cache.
+// Every deck has its own xorshift generator.
+class DeckBatch {
+private:
+    static constexpr std::size_t cardCount = 52;
+    static constexpr std::size_t tileWidth = 64;
+    static constexpr std::size_t tileSize = cardCount * tileWidth;
+
+    std::size_t deckCount;
+    std::vector<CardCode> codes;
+    std::vector<std::uint64_t> randomStates;
+
+public:
+    // The last tile is filled up with unused decks.
+    DeckBatch(std::size_t deckCount, std::uint64_t seed)
+        : deckCount{deckCount}
+        , codes(tileCount() * tileSize)
+        , randomStates(tileCount() * tileWidth) {
+        const FlatDeck standardDeck = FlatDeck::generateStandardDeck();
+
+        for(std::size_t tile = 0; tile < tileCount(); ++tile) {
+            CardCode* row = codes.data() + tile * tileSize;
+            for(const Card& card : standardDeck) {
+                std::fill_n(row, tileWidth, encodeCard(card));
+                row += tileWidth;
+            }
+        }
+
+        for(std::uint64_t& state : randomStates) {
+            state = mixSeed(seed++);
+        }
+    }
+
+    std::size_t size() const {
+        return deckCount;
+    }
+
+    std::vector<Card> cards(std::size_t deckIndex) const {
+        const CardCode* code = codes.data() +
+                               deckIndex / tileWidth * tileSize +
+                               deckIndex % tileWidth;
+
+        std::vector<Card> deck(cardCount);
+        for(Card& card : deck) {
+            card = decodeCard(*code);
+            code += tileWidth;
+        }
+        return deck;
+    }
+
+    // Fisher-Yates shuffle of every deck. Offsets are drawn by scaling 32
+    // random bits, which has negligible bias for ranges up to 52.
+    void shuffle() {
+        for(std::size_t tile = 0; tile < tileCount(); ++tile) {
+            CardCode* const tileCodes = codes.data() + tile * tileSize;
+            std::uint64_t* const states =
+                randomStates.data() + tile * tileWidth;
+
+            for(std::size_t i = 0; i + 1 < cardCount; ++i) {
+                const std::uint64_t range = cardCount - i;
+                std::uint32_t offsets[tileWidth];
+
+                for(std::size_t lane = 0; lane < tileWidth; ++lane) {
+                    std::uint64_t state = states[lane];
+                    state ^= state << 13;
+                    state ^= state >> 7;
+                    state ^= state << 17;
+                    states[lane] = state;
+                    offsets[lane] = static_cast<std::uint32_t>(
+                        ((state >> 32) * range) >> 32);
+                }
+
+                CardCode* const row = tileCodes + i * tileWidth;
+                for(std::size_t lane = 0; lane < tileWidth; ++lane) {
+                    std::swap(row[lane], row[offsets[lane] * tileWidth + lane]);
+                }
+            }
+        }
+    }
+
+    // Counting sort of ranks in every deck. Cards are placed from the back
+    // with decremented inclusive counts, which keeps equal ranks in order.
+    void stableBucketSort() {
+        for(std::size_t tile = 0; tile < tileCount(); ++tile) {
+            CardCode* const tileCodes = codes.data() + tile * tileSize;
+            unsigned char rankCounts[rankCount][tileWidth] = {};
+            CardCode sortedCodes[tileSize];
+
+            for(std::size_t position = 0; position < cardCount; ++position) {
+                const CardCode* const row = tileCodes + position * tileWidth;
+                for(std::size_t lane = 0; lane < tileWidth; ++lane) {
+                    ++rankCounts[row[lane] / 4][lane];
+                }
+            }
+
+            for(std::size_t rank = 1; rank < rankCount; ++rank) {
+                for(std::size_t lane = 0; lane < tileWidth; ++lane) {
+                    rankCounts[rank][lane] += rankCounts[rank - 1][lane];
+                }
+            }
+
+            for(std::size_t position = cardCount; position-- > 0;) {
+                const CardCode* const row = tileCodes + position * tileWidth;
+                for(std::size_t lane = 0; lane < tileWidth; ++lane) {
+                    const CardCode code = row[lane];
+                    const std::size_t sortedPosition =
+                        --rankCounts[code / 4][lane];
+                    sortedCodes[sortedPosition * tileWidth + lane] = code;
+                }
+            }
+
+            std::copy(std::begin(sortedCodes), std::end(sortedCodes),
+                      tileCodes);
+        }
+    }
+
+private:
+    std::size_t tileCount() const {
+        return (deckCount + tileWidth - 1) / tileWidth;
+    }
+
+    // SplitMix64 finalizer, which spreads consecutive seeds apart.
+    static std::uint64_t mixSeed(std::uint64_t seed) {
+        seed += 0x9E3779B97F4A7C15;
+        seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9;
+        seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EB;
+        seed ^= seed >> 31;
+        return seed != 0 ? seed : 1;
+    }
+};
+
+// Deck serialization into caller-provided buffers. The text form is the one
+// of operator<<, and the binary form is one card code per byte. Writers
+// return the end of written data and parsers return the end of parsed data,
+// so many decks can be stored in one buffer or one mapped file.
+
+// Upper bound of text size of a deck with `cardCount` cards.
+inline constexpr std::size_t deckTextCapacity(std::size_t cardCount) {
+    constexpr std::size_t maxCardTextSize = 8; // "(10|S), "
+    return 2 + cardCount * maxCardTextSize;
+}
+
+struct CardText {
+    char characters[6];
+    unsigned char size;
+};
+
+// Texts of cards, indexed by card codes, formatted once by operator<<.
+inline const std::array<CardText, 4 * rankCount>& cardTexts() {
+    static const std::array<CardText, 4 * rankCount> texts = [] {
+        std::array<CardText, 4 * rankCount> texts{};
+
+        for(std::size_t code = 0; code < texts.size(); ++code) {
+            std::ostringstream stream;
+            stream << decodeCard(static_cast<CardCode>(code));
+            const std::string text = stream.str();
+
+            assert(text.size() <= sizeof(texts[code].characters));
+            std::copy(text.begin(), text.end(), texts[code].characters);
+            texts[code].size = static_cast<unsigned char>(text.size());
+        }
+
+        return texts;
+    }();
+
+    return texts;
+}
+
+template<typename CardDeck>
+char* writeDeckText(const CardDeck& deck, char* first, char* last) {
+    const std::array<CardText, 4 * rankCount>& texts = cardTexts();
+    const auto reserve = [&](std::size_t size) {
+        if(static_cast<std::size_t>(last - first) < size) {
+            throw std::length_error{"buffer is too small for deck text"};
+        }
+    };
+
+    reserve(2);
+    *first++ = '[';
+
+    bool isFirstCard = true;
+    for(const Card& card : deck) {
+        const CardText& text = texts[encodeCard(card)];
+        reserve(text.size + (isFirstCard ? 1 : 3));
+
+        if(!isFirstCard) {
+            *first++ = ',';
+            *first++ = ' ';
+        }
+        first = std::copy_n(text.characters, text.size, first);
+        isFirstCard = false;
+    }
+
+    *first++ = ']';
+    return first;
+}
+
+template<typename CardDeck>
+char* writeDeckCodes(const CardDeck& deck, char* first, char* last) {
+    if(static_cast<std::size_t>(last - first) < deck.size()) {
+        throw std::length_error{"buffer is too small for deck codes"};
+    }
+
+    for(const Card& card : deck) {
+        *first++ = static_cast<char>(encodeCard(card));
+    }
+    return first;
+}
+
+// Replaces cards of a deck in order and reuses its nodes, so parsing into
+// the same deck again allocates nothing.
+class DeckRefiller {
+private:
+    Deck& deck;
+    Deck::Iterator lastCard;
+
+public:
+    explicit DeckRefiller(Deck& deck)
+        : deck{deck}
+        , lastCard{deck.beforeBegin()} { }
+
+    void append(const Card& card) {
+        if(std::next(lastCard) != deck.end()) {
+            *std::next(lastCard) = card;
+        } else {
+            deck.insertAfter(lastCard, card);
+        }
+        ++lastCard;
+    }
+
+    // Erases cards which were not replaced.
+    void finish() {
+        while(std::next(lastCard) != deck.end()) {
+            deck.eraseAfter(lastCard);
+        }
+    }
+};
+
+// Replaces cards of the deck with cards of the text at the beginning of
+// [first, last). Throws std::invalid_argument if the text is malformed, and
+// then the deck keeps only some of its cards replaced.
+inline const char* parseDeckText(const char* first, const char* last,
+                                 Deck& deck) {
+    const auto fail = [] {
+        throw std::invalid_argument{"malformed deck text"};
+    };
+    const auto expect = [&](char character) {
+        if(first == last || *first != character) {
+            fail();
+        }
+        ++first;
+    };
+
+    DeckRefiller refiller{deck};
+
+    expect('[');
+    if(first != last && *first == ']') {
+        refiller.finish();
+        return first + 1;
+    }
+
+    while(true) {
+        expect('(');
+        if(first == last) {
+            fail();
+        }
+
+        const char rankCharacter = *first++;
+        CardRank rank{};
+        switch(rankCharacter) {
+        case '1':
+            expect('0');
+            rank = CardRank::TEN;
+            break;
+
+        case 'J':
+            rank = CardRank::JACK;
+            break;
+
+        case 'Q':
+            rank = CardRank::QUEEN;
+            break;
+
+        case 'K':
+            rank = CardRank::KING;
+            break;
+
+        case 'A':
+            rank = CardRank::ACE;
+            break;
+
+        default:
+            if(rankCharacter < '2' || rankCharacter > '9') {
+                fail();
+            }
+            rank = static_cast<CardRank>(rankCharacter);
+        }
+
+        expect('|');
+        if(first == last) {
+            fail();
+        }
+
+        const auto suite = static_cast<CardSuite>(*first++);
+        if(suite != CardSuite::SPADE && suite != CardSuite::HEART &&
+           suite != CardSuite::DIAMOND && suite != CardSuite::CLUB) {
+            fail();
+        }
+        expect(')');
+
+        refiller.append(Card{suite, rank});
+
+        if(first != last && *first == ']') {
+            refiller.finish();
+            return first + 1;
+        }
+        expect(',');
+        expect(' ');
+    }
+}
+
+// Replaces cards of the deck with `cardCount` codes at the beginning of
+// [first, last). Throws std::invalid_argument if codes are missing or
+// invalid, and then the deck keeps only some of its cards replaced.
+inline const char* parseDeckCodes(const char* first, const char* last,
+                                  std::size_t cardCount, Deck& deck) {
+    if(static_cast<std::size_t>(last - first) < cardCount) {
+        throw std::invalid_argument{"missing deck codes"};
+    }
+
+    DeckRefiller refiller{deck};
+
+    for(const char* const end = first + cardCount; first != end; ++first) {
+        const auto code = static_cast<CardCode>(*first);
+        if(code >= 4 * rankCount) {
+            throw std::invalid_argument{"invalid card code"};
+        }
+
+        refiller.append(decodeCard(code));
+    }
+
+    refiller.finish();
+    return first;
+}